@@ -0,0 +1,233 @@
+﻿// _avl_balance.hpp : AVL 树的平衡修正
+//
+
+#pragma once
+
+#include <stdexcept>
+
+namespace ds
+{
+
+// AVL 树插入与删除后的平衡修正，avl_tree、compact_avl_tree 与 threaded_avl_tree 共用
+// 节点的表示与旋转由适配器 Ops 提供，修正过程只通过它访问树：
+//   Ops::handle                        节点的句柄，如指针或下标
+//   bool is_null(handle)               是否为空句柄
+//   handle parent(handle)              父节点
+//   handle left(handle)                左孩子，没有时为空句柄
+//   handle right(handle)               右孩子，没有时为空句柄
+//   int bf(handle)                     平衡因子，左子树高度减去右子树高度
+//   void set_bf(handle, int)
+//   void left_rotate(handle)           旋转，由树自己维护根、父链接与附加数据
+//   void right_rotate(handle)
+
+// 双旋后根据新子树根的平衡因子修正两侧节点
+// left 和 right 分别成为 top 的左右孩子
+template <typename Ops>
+void _avl_fix_double_rotate_bf(const Ops &ops, typename Ops::handle top, typename Ops::handle left,
+                               typename Ops::handle right)
+{
+    int bf = ops.bf(top);
+    ops.set_bf(left, bf == -1 ? 1 : 0);
+    ops.set_bf(right, bf == 1 ? -1 : 0);
+    ops.set_bf(top, 0);
+}
+
+// 插入后修正，node 为新链接的叶节点
+template <typename Ops>
+void _avl_insert_fix_up(const Ops &ops, typename Ops::handle node)
+{
+    using handle = typename Ops::handle;
+
+    while (true)
+    {
+        handle p = ops.parent(node);
+        if (ops.is_null(p))
+            return;
+
+        if (ops.left(p) == node)
+        {
+            switch (ops.bf(p))
+            {
+            case -1:
+            {
+                ops.set_bf(p, 0);
+                return;
+            }
+            case 0:
+            {
+                ops.set_bf(p, 1);
+                node = p;
+                continue;
+            }
+            case 1:
+            {
+                if (ops.bf(node) == -1)
+                {
+                    handle top = ops.right(node);
+                    ops.left_rotate(node);
+                    ops.right_rotate(p);
+                    _avl_fix_double_rotate_bf(ops, top, node, p);
+                }
+                else
+                {
+                    ops.right_rotate(p);
+                    ops.set_bf(p, 0);
+                    ops.set_bf(node, 0);
+                }
+
+                return;
+            }
+            default:
+                throw std::logic_error("预料之外的平衡因子值");
+            }
+        }
+        else
+        {
+            switch (ops.bf(p))
+            {
+            case -1:
+            {
+                if (ops.bf(node) == 1)
+                {
+                    handle top = ops.left(node);
+                    ops.right_rotate(node);
+                    ops.left_rotate(p);
+                    _avl_fix_double_rotate_bf(ops, top, p, node);
+                }
+                else
+                {
+                    ops.left_rotate(p);
+                    ops.set_bf(p, 0);
+                    ops.set_bf(node, 0);
+                }
+
+                return;
+            }
+            case 0:
+            {
+                ops.set_bf(p, -1);
+                node = p;
+                continue;
+            }
+            case 1:
+            {
+                ops.set_bf(p, 0);
+                return;
+            }
+            default:
+                throw std::logic_error("预料之外的平衡因子值");
+            }
+        }
+    }
+}
+
+// 删除后修正，is_left_child 表示 parent 的哪一侧高度降低
+template <typename Ops>
+void _avl_erase_fix_up(const Ops &ops, bool is_left_child, typename Ops::handle parent)
+{
+    using handle = typename Ops::handle;
+
+    while (true)
+    {
+        // 高度降低了的子树的根
+        handle top;
+
+        if (is_left_child)
+        {
+            switch (ops.bf(parent))
+            {
+            case -1:
+            {
+                handle right = ops.right(parent);
+                if (ops.bf(right) == 1)
+                {
+                    top = ops.left(right);
+                    ops.right_rotate(right);
+                    ops.left_rotate(parent);
+                    _avl_fix_double_rotate_bf(ops, top, parent, right);
+                    break;
+                }
+
+                ops.left_rotate(parent);
+                if (ops.bf(right) == 0)
+                {
+                    ops.set_bf(parent, -1);
+                    ops.set_bf(right, 1);
+                    return;
+                }
+
+                ops.set_bf(parent, 0);
+                ops.set_bf(right, 0);
+                top = right;
+                break;
+            }
+            case 0:
+            {
+                ops.set_bf(parent, -1);
+                return;
+            }
+            case 1:
+            {
+                ops.set_bf(parent, 0);
+                top = parent;
+                break;
+            }
+            default:
+                throw std::logic_error("预料之外的平衡因子值");
+            }
+        }
+        else
+        {
+            switch (ops.bf(parent))
+            {
+            case -1:
+            {
+                ops.set_bf(parent, 0);
+                top = parent;
+                break;
+            }
+            case 0:
+            {
+                ops.set_bf(parent, 1);
+                return;
+            }
+            case 1:
+            {
+                handle left = ops.left(parent);
+                if (ops.bf(left) == -1)
+                {
+                    top = ops.right(left);
+                    ops.left_rotate(left);
+                    ops.right_rotate(parent);
+                    _avl_fix_double_rotate_bf(ops, top, left, parent);
+                    break;
+                }
+
+                ops.right_rotate(parent);
+                if (ops.bf(left) == 0)
+                {
+                    ops.set_bf(parent, 1);
+                    ops.set_bf(left, -1);
+                    return;
+                }
+
+                ops.set_bf(parent, 0);
+                ops.set_bf(left, 0);
+                top = left;
+                break;
+            }
+            default:
+                throw std::logic_error("预料之外的平衡因子值");
+            }
+        }
+
+        handle gp = ops.parent(top);
+        if (ops.is_null(gp))
+            return;
+
+        is_left_child = ops.left(gp) == top;
+        parent = gp;
+    }
+}
+
+} // namespace ds
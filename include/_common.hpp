@@ -8,6 +8,14 @@
 #include <type_traits>
 #include <initializer_list>
 #include <iterator>
+#include <algorithm>
+#include <exception>
+#include <thread>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <xmmintrin.h>
+#endif
 
 namespace ds
 {
@@ -20,4 +28,77 @@ inline void _swap_adl(Ty &left, Ty &right) noexcept(noexcept(swap(left, right)))
     swap(left, right);
 }
 
+// 软件预取，提示处理器将 ptr 所在的缓存行读入缓存
+// 只是提示，ptr 无效时也不会出错；不支持的平台上什么也不做
+inline void _prefetch(const void *ptr) noexcept
+{
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+    _mm_prefetch(static_cast<const char *>(ptr), _MM_HINT_T0);
+#elif defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(ptr);
+#else
+    (void)ptr;
+#endif
+}
+
+// 在 count 个线程上并行调用 f(0), f(1), ..., f(count - 1)，其中一个在当前线程执行
+// 全部结束后重新抛出第一个异常
+template <typename Fn>
+void _run_parallel(size_t count, Fn f)
+{
+    std::vector<std::exception_ptr> errors(count);
+    auto run = [&f, &errors](size_t i) {
+        try
+        {
+            f(i);
+        }
+        catch (...)
+        {
+            errors[i] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(count);
+    for (size_t i = 1; i < count; ++i)
+        threads.emplace_back(run, i);
+    run(0);
+    for (std::thread &t : threads)
+        t.join();
+
+    for (const std::exception_ptr &e : errors)
+    {
+        if (e)
+            std::rethrow_exception(e);
+    }
+}
+
+// 多线程稳定排序：各线程先排序一段，再逐轮两两归并相邻的段，相等的元素保持原来的顺序
+// 每个线程至少分到 min_chunk 个元素，元素不够时退化为 std::stable_sort
+template <typename RandomIt>
+void _parallel_sort(RandomIt first, RandomIt last, size_t thread_count, size_t min_chunk = 1 << 14)
+{
+    size_t n = static_cast<size_t>(last - first);
+    size_t k = std::min(thread_count, n / min_chunk);
+    if (k <= 1)
+    {
+        std::stable_sort(first, last);
+        return;
+    }
+
+    std::vector<RandomIt> bounds;
+    for (size_t i = 0; i <= k; ++i)
+        bounds.push_back(first + static_cast<ptrdiff_t>(n * i / k));
+
+    _run_parallel(k, [&bounds](size_t i) { std::stable_sort(bounds[i], bounds[i + 1]); });
+    for (size_t width = 1; width < k; width *= 2)
+    {
+        _run_parallel((k + 2 * width - 1) / (2 * width), [&bounds, width, k](size_t i) {
+            size_t lo = 2 * width * i, mid = lo + width;
+            if (mid < k)
+                std::inplace_merge(bounds[lo], bounds[mid], bounds[std::min(mid + width, k)]);
+        });
+    }
+}
+
 } // namespace ds
@@ -0,0 +1,149 @@
+﻿// _epoch.hpp : 基于纪元的内存回收
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace ds
+{
+
+// 基于纪元的内存回收
+// 读者进入临界区时在独占的槽位中登记当前纪元，期间不写任何共享数据
+// 写者摘除的节点先挂入垃圾表，待所有可能看到它的读者离开后再释放
+// 写者之间须由调用方串行化
+class _epoch_domain
+{
+public:
+    static constexpr size_t max_readers = 256; // 同时活跃的读者上限
+
+private:
+    // 每个槽位独占一条缓存行，避免读者之间伪共享
+    struct alignas(64) _slot
+    {
+        std::atomic<uint64_t> epoch{0}; // 0 表示空闲
+    };
+
+    struct _retired
+    {
+        void *ptr;
+        void (*deleter)(void *);
+        uint64_t epoch;
+    };
+
+public:
+    // 读者临界区，生命期内看到的节点不会被释放
+    class guard
+    {
+        friend class _epoch_domain;
+
+        explicit guard(_slot *slot) noexcept : _slot_ptr(slot) {}
+
+    public:
+        guard(guard &&other) noexcept : _slot_ptr(other._slot_ptr)
+        {
+            other._slot_ptr = nullptr;
+        }
+
+        guard(const guard &) = delete;
+        guard &operator=(const guard &) = delete;
+        guard &operator=(guard &&) = delete;
+
+        ~guard()
+        {
+            if (_slot_ptr)
+                _slot_ptr->epoch.store(0, std::memory_order_release);
+        }
+
+    private:
+        _slot *_slot_ptr;
+    };
+
+public:
+    _epoch_domain() = default;
+
+    _epoch_domain(const _epoch_domain &) = delete;
+    _epoch_domain &operator=(const _epoch_domain &) = delete;
+
+    // 调用时不应再有活跃的读者
+    ~_epoch_domain()
+    {
+        for (const _retired &r : _garbage)
+            r.deleter(r.ptr);
+    }
+
+    // 进入读者临界区
+    // 每次调用都有一次原子读改写：进入时以 CAS 占用槽位，guard 析构时以 release 写入释放
+    // 从线程对应的槽位开始寻找空闲槽位，同时持有 guard 超过 max_readers 个时让出时间片等待
+    // 需要反复进入时，应长期持有一个 guard 并用 refresh 代替重新登记
+    [[nodiscard]] guard pin() noexcept
+    {
+        size_t i = std::hash<std::thread::id>{}(std::this_thread::get_id()) % max_readers;
+        while (true)
+        {
+            for (size_t n = 0; n < max_readers; ++n, i = (i + 1) % max_readers)
+            {
+                uint64_t expected = 0;
+                if (_slots[i].epoch.load(std::memory_order_relaxed) == 0 &&
+                    _slots[i].epoch.compare_exchange_strong(expected, _global.load()))
+                    return guard(&_slots[i]);
+            }
+
+            std::this_thread::yield();
+        }
+    }
+
+    // 读者：把 guard 登记的纪元更新为当前纪元，此前读到的对象此后可能被释放
+    // 只写 guard 独占的槽位，不与其他读者争用，也不会等待
+    void refresh(guard &g) noexcept
+    {
+        g._slot_ptr->epoch.store(_global.load());
+    }
+
+    // 写者：在新版本发布后推迟释放不再可达的对象
+    void retire(void *ptr, void (*deleter)(void *))
+    {
+        _garbage.push_back({ptr, deleter, _global.load()});
+    }
+
+    // 写者：推进纪元并释放所有活跃读者都看不到的对象
+    void reclaim()
+    {
+        _global.fetch_add(1);
+
+        uint64_t min_epoch = UINT64_MAX;
+        for (const _slot &slot : _slots)
+        {
+            uint64_t e = slot.epoch.load();
+            if (e != 0 && e < min_epoch)
+                min_epoch = e;
+        }
+
+        size_t kept = 0;
+        for (const _retired &r : _garbage)
+        {
+            if (r.epoch < min_epoch)
+                r.deleter(r.ptr);
+            else
+                _garbage[kept++] = r;
+        }
+        _garbage.resize(kept);
+    }
+
+    // 等待释放的对象数量
+    [[nodiscard]] size_t pending() const noexcept
+    {
+        return _garbage.size();
+    }
+
+private:
+    std::atomic<uint64_t> _global{1};
+    _slot _slots[max_readers];
+    std::vector<_retired> _garbage;
+}; // class _epoch_domain
+
+} // namespace ds
@@ -0,0 +1,242 @@
+﻿// _snapshot.hpp : 有序元素的二进制快照
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace ds
+{
+
+// 快照格式，各字段均为本机字节序：
+//   文件头  _snapshot_header
+//   元素    count 个 element_size 字节的元素，按升序排列
+//   校验和  8 字节，覆盖文件头与全部元素
+// 字节序或元素大小不同的快照在读取时因文件头不符而被拒绝
+struct _snapshot_header
+{
+    static constexpr uint32_t _magic = 0x53574453; // "SDWS"，字节序不同时读出的值不同
+    static constexpr uint32_t _version = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint64_t element_size;
+    uint64_t count;
+};
+
+// 快照的校验和：以 8 字节为一组的 FNV-1a
+// 分组与 update 的调用方式无关，分块写入与一次读入得到相同的结果
+class _snapshot_checksum
+{
+public:
+    void update(const void *data, size_t size) noexcept
+    {
+        auto *p = static_cast<const unsigned char *>(data);
+        _length += size;
+
+        // 先补齐上次剩下的不足一组的字节
+        for (; size > 0 && _pending_size != 0; ++p, --size)
+            _push_byte(*p);
+
+        for (; size >= 8; p += 8, size -= 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, p, 8);
+            _mix(word);
+        }
+
+        for (; size > 0; ++p, --size)
+            _push_byte(*p);
+    }
+
+    [[nodiscard]] uint64_t value() const noexcept
+    {
+        _snapshot_checksum tmp = *this;
+        if (tmp._pending_size != 0)
+        {
+            std::memset(tmp._pending + tmp._pending_size, 0, 8 - tmp._pending_size);
+            uint64_t word;
+            std::memcpy(&word, tmp._pending, 8);
+            tmp._mix(word);
+        }
+        tmp._mix(tmp._length);
+        return tmp._hash;
+    }
+
+private:
+    void _mix(uint64_t word) noexcept
+    {
+        _hash = (_hash ^ word) * 0x100000001b3;
+    }
+
+    void _push_byte(unsigned char byte) noexcept
+    {
+        _pending[_pending_size++] = byte;
+        if (_pending_size == 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, _pending, 8);
+            _mix(word);
+            _pending_size = 0;
+        }
+    }
+
+    uint64_t _hash = 0xcbf29ce484222325;
+    uint64_t _length = 0;
+    unsigned char _pending[8]{};
+    size_t _pending_size = 0;
+};
+
+// 写出 count 个元素的快照，next() 依次返回各个元素
+// 元素先复制到缓冲区，再成块写出
+template <typename Ty, typename Fn>
+void _save_snapshot(std::ostream &out, uint64_t count, Fn next)
+{
+    static_assert(std::is_trivially_copyable_v<Ty>, "快照只支持可平凡复制的元素类型");
+
+    constexpr size_t chunk = 1 << 14;
+
+    _snapshot_checksum checksum;
+    auto write = [&out, &checksum](const void *data, size_t size) {
+        checksum.update(data, size);
+        out.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+    };
+
+    _snapshot_header header{_snapshot_header::_magic, _snapshot_header::_version, sizeof(Ty), count};
+    write(&header, sizeof(header));
+
+    std::vector<Ty> buffer;
+    buffer.reserve(count < chunk ? static_cast<size_t>(count) : chunk);
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        buffer.push_back(next());
+        if (buffer.size() == chunk || i + 1 == count)
+        {
+            write(buffer.data(), buffer.size() * sizeof(Ty));
+            buffer.clear();
+        }
+    }
+
+    uint64_t sum = checksum.value();
+    out.write(reinterpret_cast<const char *>(&sum), sizeof(sum));
+    if (!out)
+        throw std::runtime_error("写入快照失败");
+}
+
+inline void _check_snapshot_header(const _snapshot_header &header, size_t element_size)
+{
+    if (header.magic != _snapshot_header::_magic || header.version != _snapshot_header::_version)
+        throw std::runtime_error("不是快照或版本不符");
+    if (header.element_size != element_size)
+        throw std::runtime_error("快照的元素大小不符");
+}
+
+// 从流中读入快照的全部元素并校验
+// 元素分块读入，文件头中的个数被篡改时不会预先分配过多内存
+template <typename Ty>
+std::vector<Ty> _load_snapshot(std::istream &in)
+{
+    static_assert(std::is_trivially_copyable_v<Ty>, "快照只支持可平凡复制的元素类型");
+
+    constexpr size_t chunk = 1 << 14;
+
+    _snapshot_checksum checksum;
+    auto read = [&in, &checksum](void *data, size_t size) {
+        in.read(static_cast<char *>(data), static_cast<std::streamsize>(size));
+        if (static_cast<size_t>(in.gcount()) != size)
+            throw std::runtime_error("快照不完整");
+        checksum.update(data, size);
+    };
+
+    _snapshot_header header;
+    read(&header, sizeof(header));
+    _check_snapshot_header(header, sizeof(Ty));
+
+    std::vector<Ty> elements;
+    for (uint64_t rest = header.count; rest > 0;)
+    {
+        size_t n = rest < chunk ? static_cast<size_t>(rest) : chunk;
+        size_t old_size = elements.size();
+        elements.resize(old_size + n);
+        read(elements.data() + old_size, n * sizeof(Ty));
+        rest -= n;
+    }
+
+    uint64_t sum;
+    in.read(reinterpret_cast<char *>(&sum), sizeof(sum));
+    if (static_cast<size_t>(in.gcount()) != sizeof(sum) || sum != checksum.value())
+        throw std::runtime_error("快照校验和不符");
+
+    return elements;
+}
+
+// 内存中的快照，例如映射到内存的快照文件
+// 构造时校验整个快照，之后直接从缓冲区逐个复制元素，缓冲区不必按 Ty 对齐
+template <typename Ty>
+class _snapshot_view
+{
+    static_assert(std::is_trivially_copyable_v<Ty>, "快照只支持可平凡复制的元素类型");
+
+public:
+    _snapshot_view(const void *data, size_t size)
+    {
+        auto *bytes = static_cast<const unsigned char *>(data);
+
+        _snapshot_header header;
+        if (size < sizeof(header) + sizeof(uint64_t))
+            throw std::runtime_error("快照不完整");
+        std::memcpy(&header, bytes, sizeof(header));
+        _check_snapshot_header(header, sizeof(Ty));
+
+        size_t payload = size - sizeof(header) - sizeof(uint64_t);
+        if (header.count != payload / sizeof(Ty) || payload % sizeof(Ty) != 0)
+            throw std::runtime_error("快照不完整");
+
+        _snapshot_checksum checksum;
+        checksum.update(bytes, sizeof(header) + payload);
+
+        uint64_t sum;
+        std::memcpy(&sum, bytes + sizeof(header) + payload, sizeof(sum));
+        if (sum != checksum.value())
+            throw std::runtime_error("快照校验和不符");
+
+        _elements = bytes + sizeof(header);
+        _count = static_cast<size_t>(header.count);
+    }
+
+    [[nodiscard]] size_t size() const noexcept
+    {
+        return _count;
+    }
+
+    [[nodiscard]] Ty operator[](size_t i) const noexcept
+    {
+        Ty e;
+        std::memcpy(&e, _elements + i * sizeof(Ty), sizeof(Ty));
+        return e;
+    }
+
+private:
+    const unsigned char *_elements;
+    size_t _count;
+};
+
+// 检查 value_at(0), ..., value_at(n - 1) 是否升序，strict 为真时还要求互不相等
+template <typename Ty, typename Fn>
+void _check_snapshot_order(size_t n, Fn value_at, bool strict)
+{
+    for (size_t i = 1; i < n; ++i)
+    {
+        const Ty prev = value_at(i - 1), cur = value_at(i);
+        if (cur < prev || (strict && !(prev < cur)))
+            throw std::runtime_error("快照中的元素不是升序");
+    }
+}
+
+} // namespace ds
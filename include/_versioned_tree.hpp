@@ -0,0 +1,430 @@
+﻿// _versioned_tree.hpp : 路径复制的多版本二叉树的公共部分
+//
+
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "_epoch.hpp"
+
+namespace ds
+{
+
+// 路径复制的多版本二叉树的公共部分，persistent_avl_tree 与 concurrent_rb_tree 以此为基础
+// 写者复制从根到修改位置的路径，新版本通过一次原子指针交换发布
+// 读者只在进入时登记纪元，遍历期间不加锁、不写任何共享数据
+// 写者之间由内部的互斥量串行化，被替换的节点在所有读者离开后回收
+// Node 须有 data、stamp、left、right 成员，平衡所需的其他字段由派生类维护
+template <typename Ty, typename Node>
+class _versioned_tree
+{
+public:
+    using value_type = Ty;
+    using size_type = size_t;
+
+    using const_reference = const value_type &;
+
+protected:
+    using _node = Node;
+
+    // 一个版本
+    struct _version
+    {
+        _node *root;
+        size_type size;
+    };
+
+public:
+    class snapshot;
+
+    // 快照的迭代器，中序遍历
+    class const_iterator
+    {
+        friend class snapshot;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+
+        using value_type = Ty;
+        using difference_type = ptrdiff_t;
+        using pointer = const value_type *;
+        using reference = const value_type &;
+
+        const_iterator() = default;
+
+    private:
+        explicit const_iterator(_node *root)
+        {
+            _push_left(root);
+        }
+
+        void _push_left(_node *node)
+        {
+            for (; node; node = node->left)
+                _stack.push_back(node);
+        }
+
+    public:
+        // 解引用
+        [[nodiscard]] reference operator*() const
+        {
+            assert(!_stack.empty());
+            return _stack.back()->data;
+        }
+        [[nodiscard]] pointer operator->() const
+        {
+            assert(!_stack.empty());
+            return &_stack.back()->data;
+        }
+
+        // 自增
+        const_iterator &operator++()
+        {
+            assert(!_stack.empty());
+
+            _node *node = _stack.back();
+            _stack.pop_back();
+            _push_left(node->right);
+            return *this;
+        }
+        const_iterator operator++(int)
+        {
+            const_iterator tmp = *this;
+            ++*this;
+            return tmp;
+        }
+
+        friend bool operator==(const const_iterator &left, const const_iterator &right)
+        {
+            if (left._stack.empty() || right._stack.empty())
+                return left._stack.empty() && right._stack.empty();
+            return left._stack.back() == right._stack.back();
+        }
+        friend bool operator!=(const const_iterator &left, const const_iterator &right)
+        {
+            return !(left == right);
+        }
+
+    private:
+        std::vector<_node *> _stack; // 尚未访问的祖先，栈顶为当前节点
+    };
+
+    // 某一时刻的只读视图
+    // 生命期内看到的节点不会被回收，应尽快释放以免积压垃圾
+    // 需要连续多次查找时，持有一个快照比反复调用 contains 更快
+    class snapshot
+    {
+        friend class _versioned_tree;
+
+        snapshot(_epoch_domain::guard &&guard, const _version *version)
+            : _guard(std::move(guard)), _version_ptr(version) {}
+
+    public:
+        [[nodiscard]] size_type size() const noexcept
+        {
+            return _version_ptr->size;
+        }
+
+        [[nodiscard]] bool empty() const noexcept
+        {
+            return _version_ptr->size == 0;
+        }
+
+        // 查找元素，不存在时返回 nullptr
+        [[nodiscard]] const value_type *find(const value_type &val) const
+        {
+            _node *node = _find(_version_ptr->root, val);
+            return node ? &node->data : nullptr;
+        }
+
+        [[nodiscard]] bool contains(const value_type &val) const
+        {
+            return find(val) != nullptr;
+        }
+
+        // 第一个不小于 val 的元素，不存在时返回 nullptr
+        [[nodiscard]] const value_type *lower_bound(const value_type &val) const
+        {
+            _node *node = _lower_bound(_version_ptr->root, val);
+            return node ? &node->data : nullptr;
+        }
+
+        // 迭代器
+        [[nodiscard]] const_iterator begin() const
+        {
+            return const_iterator(_version_ptr->root);
+        }
+
+        [[nodiscard]] const_iterator end() const
+        {
+            return {};
+        }
+
+    private:
+        _epoch_domain::guard _guard;
+        const _version *_version_ptr;
+    };
+
+    // 长期持有的读者，反复查找时的快速路径
+    // 纪元只在创建时登记一次，之后每次查找只读取一次当前版本，没有原子读改写
+    // 与快照不同，每次查找都看到最新发布的版本
+    // 持有期间发布的版本都不能回收，应在批次之间调用 refresh，不再使用时及时释放
+    class reader
+    {
+        friend class _versioned_tree;
+
+        reader(_epoch_domain::guard &&guard, const _versioned_tree *tree)
+            : _guard(std::move(guard)), _tree(tree) {}
+
+    public:
+        [[nodiscard]] size_type size() const noexcept
+        {
+            return _tree->_current.load()->size;
+        }
+
+        [[nodiscard]] bool empty() const noexcept
+        {
+            return size() == 0;
+        }
+
+        // 查找元素，不存在时返回 nullptr
+        // 返回的指针在下次 refresh 或读者析构之前有效
+        [[nodiscard]] const value_type *find(const value_type &val) const
+        {
+            _node *node = _find(_tree->_current.load()->root, val);
+            return node ? &node->data : nullptr;
+        }
+
+        [[nodiscard]] bool contains(const value_type &val) const
+        {
+            return find(val) != nullptr;
+        }
+
+        // 第一个不小于 val 的元素，不存在时返回 nullptr
+        [[nodiscard]] const value_type *lower_bound(const value_type &val) const
+        {
+            _node *node = _lower_bound(_tree->_current.load()->root, val);
+            return node ? &node->data : nullptr;
+        }
+
+        // 允许回收此前的版本，此前 find 与 lower_bound 返回的指针随之失效
+        void refresh() noexcept
+        {
+            _tree->_epoch.refresh(_guard);
+        }
+
+    private:
+        _epoch_domain::guard _guard;
+        const _versioned_tree *_tree;
+    };
+
+protected:
+    _versioned_tree() : _current(new _version{nullptr, 0}) {}
+
+public:
+    _versioned_tree(const _versioned_tree &) = delete;
+    _versioned_tree(_versioned_tree &&) = delete;
+    _versioned_tree &operator=(const _versioned_tree &) = delete;
+    _versioned_tree &operator=(_versioned_tree &&) = delete;
+
+private:
+    // 释放整棵树，仅用于析构
+    static void _free_node(_node *node)
+    {
+        if (!node)
+            return;
+
+        _free_node(node->left);
+        _free_node(node->right);
+
+        delete node;
+    }
+
+    static void _delete_node(void *ptr)
+    {
+        delete static_cast<_node *>(ptr);
+    }
+
+    static void _delete_version(void *ptr)
+    {
+        delete static_cast<_version *>(ptr);
+    }
+
+public:
+    // 调用时不应再有存活的快照
+    ~_versioned_tree()
+    {
+        _version *version = _current.load();
+        _free_node(version->root);
+        delete version;
+    }
+
+protected:
+    static _node *_find(_node *p, const value_type &val)
+    {
+        while (p)
+        {
+            if (p->data < val)
+                p = p->right;
+            else if (val < p->data)
+                p = p->left;
+            else
+                return p;
+        }
+        return nullptr;
+    }
+
+    static _node *_lower_bound(_node *p, const value_type &val)
+    {
+        _node *result = nullptr;
+        while (p)
+        {
+            if (p->data < val)
+                p = p->right;
+            else
+            {
+                result = p;
+                p = p->left;
+            }
+        }
+        return result;
+    }
+
+    // 创建本次修改的新节点，args 依次初始化 Node 的各个成员
+    // 先占好 _fresh 中的位置，构造抛出异常时也不会遗漏已创建的节点
+    template <typename... Args>
+    _node *_make_node(Args &&... args)
+    {
+        _fresh.push_back(nullptr);
+        return _fresh.back() = new _node{std::forward<Args>(args)...};
+    }
+
+    // 取得可原地修改的节点
+    // 已发布的节点被复制，原节点在新版本发布后回收
+    _node *_own(_node *node)
+    {
+        if (node->stamp == _stamp)
+            return node;
+
+        _fresh.push_back(nullptr);
+        _node *copy = _fresh.back() = new _node(*node);
+        copy->stamp = _stamp;
+        _garbage.push_back(node);
+        return copy;
+    }
+
+    // 丢弃被删除的节点
+    // 本次修改创建的节点从未发布，但修改失败时仍要经 _fresh 释放，只能在发布时释放
+    void _drop(_node *node)
+    {
+        if (node->stamp == _stamp)
+            _discarded.push_back(node);
+        else
+            _garbage.push_back(node);
+    }
+
+    // 在写锁下执行一次修改
+    // f(root) 返回新的根与元素个数的变化，变化为 0 时表示没有修改，不发布新版本
+    // f 抛出异常时撤销：已发布的节点从未被改动，释放本次创建的全部节点即可
+    template <typename Fn>
+    bool _modify(Fn f)
+    {
+        std::lock_guard<std::mutex> lock(_write_mutex);
+
+        _version *version = _current.load();
+        ++_stamp;
+
+        std::pair<_node *, ptrdiff_t> result;
+        try
+        {
+            result = f(version->root);
+        }
+        catch (...)
+        {
+            _rollback();
+            throw;
+        }
+
+        if (result.second == 0)
+        {
+            _rollback();
+            return false;
+        }
+
+        _publish(result.first, version->size + result.second);
+        return true;
+    }
+
+private:
+    void _rollback() noexcept
+    {
+        for (_node *node : _fresh)
+            delete node;
+        _fresh.clear();
+        _discarded.clear();
+        _garbage.clear();
+    }
+
+    // 发布新版本并回收旧节点
+    void _publish(_node *root, size_type size)
+    {
+        _version *old = _current.exchange(new _version{root, size});
+
+        for (_node *node : _discarded)
+            delete node;
+        _discarded.clear();
+        _fresh.clear();
+
+        for (_node *node : _garbage)
+            _epoch.retire(node, _delete_node);
+        _garbage.clear();
+        _epoch.retire(old, _delete_version);
+
+        _epoch.reclaim();
+    }
+
+public:
+    // 取得当前版本的快照
+    // 不等待写者，但同时存活的快照与读者超过 _epoch_domain::max_readers 个时会等待其中之一释放
+    [[nodiscard]] snapshot get_snapshot() const
+    {
+        _epoch_domain::guard guard = _epoch.pin();
+        return snapshot(std::move(guard), _current.load());
+    }
+
+    // 取得长期持有的读者，等待条件与 get_snapshot 相同
+    [[nodiscard]] reader get_reader() const
+    {
+        return reader(_epoch.pin(), this);
+    }
+
+    // 以下两个函数每次调用都登记并释放一次纪元，即一次 CAS 与一次 release 写入
+    // 反复查找时应使用 get_reader 或 get_snapshot
+    [[nodiscard]] bool contains(const value_type &val) const
+    {
+        return get_snapshot().contains(val);
+    }
+
+    [[nodiscard]] size_type size() const
+    {
+        return get_snapshot().size();
+    }
+
+protected:
+    std::atomic<_version *> _current; // 当前版本
+
+    std::mutex _write_mutex;          // 串行化写者
+    uint64_t _stamp = 0;              // 修改序号
+    std::vector<_node *> _garbage;    // 本次修改替换掉的已发布节点
+    std::vector<_node *> _fresh;      // 本次修改创建的节点
+    std::vector<_node *> _discarded;  // 本次修改创建后又被删除的节点
+    mutable _epoch_domain _epoch;
+}; // class _versioned_tree<>
+
+} // namespace ds
@@ -0,0 +1,132 @@
+﻿// avl_map.hpp : 基于 AVL 树的映射
+//
+
+#pragma once
+
+#include <initializer_list>
+#include <tuple>
+#include <utility>
+
+#include "avl_tree.hpp"
+
+namespace ds
+{
+
+// 映射的类型特征
+// 关键字与值保存在同一节点中
+template <typename Key, typename Value>
+struct _avl_map_traits
+{
+    using key_type = Key;
+    using mapped_type = Value;
+    using value_type = std::pair<const Key, Value>;
+
+    static constexpr bool _multi = false;
+    using _augment_type = _avl_tree_no_augment;
+
+    // 取得元素的关键字
+    static const key_type &_kfn(const value_type &val) noexcept
+    {
+        return val.first;
+    }
+};
+
+// 基于 AVL 树的映射
+template <typename Key, typename Value>
+class avl_map : public _avl_tree<_avl_map_traits<Key, Value>>
+{
+    using _base = _avl_tree<_avl_map_traits<Key, Value>>;
+    using typename _base::_node;
+
+public:
+    using key_type = Key;
+    using mapped_type = Value;
+    using typename _base::value_type;
+    using typename _base::iterator;
+    using typename _base::const_iterator;
+
+public: // 构造函数
+    avl_map()
+    {
+    }
+
+    template <typename InputIt>
+    avl_map(InputIt first, InputIt last)
+    {
+        for (; first != last; ++first)
+            try_emplace(first->first, first->second);
+    }
+
+    avl_map(std::initializer_list<value_type> ilist) : avl_map(ilist.begin(), ilist.end()) {}
+
+private:
+    // 关键字不存在时以 args 构造值并插入，否则不做任何事
+    template <typename K, typename... Args>
+    std::pair<iterator, bool> _try_emplace(K &&key, Args &&... args)
+    {
+        auto [node, parent, is_left] = this->_find_insert_pos(key);
+        if (node)
+            return {this->_make_iter(node), false};
+
+        node = this->_new_node(std::piecewise_construct,
+                               std::forward_as_tuple(std::forward<K>(key)),
+                               std::forward_as_tuple(std::forward<Args>(args)...));
+        return {this->_make_iter(this->_link_node(node, parent, is_left)), true};
+    }
+
+    // 关键字不存在时插入，否则为已有的值赋值
+    template <typename K, typename M>
+    std::pair<iterator, bool> _insert_or_assign(K &&key, M &&obj)
+    {
+        auto [node, parent, is_left] = this->_find_insert_pos(key);
+        if (node)
+        {
+            node->data.second = std::forward<M>(obj);
+            return {this->_make_iter(node), false};
+        }
+
+        node = this->_new_node(std::forward<K>(key), std::forward<M>(obj));
+        return {this->_make_iter(this->_link_node(node, parent, is_left)), true};
+    }
+
+public:
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const key_type &key, Args &&... args)
+    {
+        return _try_emplace(key, std::forward<Args>(args)...);
+    }
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(key_type &&key, Args &&... args)
+    {
+        return _try_emplace(std::move(key), std::forward<Args>(args)...);
+    }
+
+    template <typename M>
+    std::pair<iterator, bool> insert_or_assign(const key_type &key, M &&obj)
+    {
+        return _insert_or_assign(key, std::forward<M>(obj));
+    }
+    template <typename M>
+    std::pair<iterator, bool> insert_or_assign(key_type &&key, M &&obj)
+    {
+        return _insert_or_assign(std::move(key), std::forward<M>(obj));
+    }
+
+    // 访问值，关键字不存在时插入值初始化的值
+    mapped_type &operator[](const key_type &key)
+    {
+        return try_emplace(key).first->second;
+    }
+    mapped_type &operator[](key_type &&key)
+    {
+        return try_emplace(std::move(key)).first->second;
+    }
+
+    // 按关键字查找，不构造任何值
+    [[nodiscard]] iterator find(const key_type &key)
+    {
+        return this->search(key);
+    }
+}; // class avl_map<>
+
+} // namespace ds
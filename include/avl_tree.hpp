@@ -3,31 +3,74 @@
 
 #pragma once
 
+#include <algorithm>
 #include <iterator>
 #include <cassert>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "_avl_balance.hpp"
+#include "_common.hpp"
+#include "_snapshot.hpp"
 
 namespace ds
 {
 
+template <typename Traits>
+class _avl_tree;
+
+// 不附加任何数据的节点
+struct _avl_tree_no_augment
+{
+};
+
+// Traits::_top_down 为真时，附加数据依赖祖先，不能由孩子算出，见 _avl_tree
+template <typename Traits, typename = void>
+struct _avl_tree_top_down : std::false_type
+{
+};
+
+template <typename Traits>
+struct _avl_tree_top_down<Traits, std::void_t<decltype(Traits::_top_down)>> : std::bool_constant<Traits::_top_down>
+{
+};
+
+// 集合的类型特征
+// 元素本身即为关键字
 template <typename Ty>
-class avl_tree;
+struct _avl_tree_traits
+{
+	using key_type = Ty;
+	using value_type = Ty;
+
+	static constexpr bool _multi = false;		  // 是否允许重复关键字
+	using _augment_type = _avl_tree_no_augment; // 节点附加数据
+
+	// 取得元素的关键字
+	static const key_type &_kfn(const value_type &val) noexcept
+	{
+		return val;
+	}
+};
 
 // 迭代器
-template <typename Ty>
+template <typename Traits>
 class _avl_tree_const_iterator
 {
-	friend class avl_tree<Ty>;
+	friend class _avl_tree<Traits>;
 
 public:
 	using iterator_category = std::bidirectional_iterator_tag;
 
-	using value_type = Ty;
+	using value_type = typename Traits::value_type;
 	using difference_type = ptrdiff_t;
 	using pointer = value_type *;
 	using reference = value_type &;
 
 private:
-	using _node = typename avl_tree<Ty>::_node;
+	using _node = typename _avl_tree<Traits>::_node;
 
 	_avl_tree_const_iterator(_node *node, bool is_end = false) : _ptr(node), _is_end(is_end) {}
 
@@ -49,23 +92,10 @@ public:
 	{
 		assert(!_is_end && _ptr);
 
-		if (_ptr->right)
-		{
-			for (_ptr = _ptr->right; _ptr->left; _ptr = _ptr->left)
-				;
-		}
+		if (_node *next = _avl_tree<Traits>::_next(_ptr))
+			_ptr = next;
 		else
-		{
-			_node *pt = _ptr;
-			while (pt->parent && pt->parent->right == pt)
-				pt = pt->parent;
-			pt = pt->parent;
-
-			if (pt)
-				_ptr = pt;
-			else
-				_is_end = true; // 尾后
-		}
+			_is_end = true; // 尾后
 
 		return *this;
 	}
@@ -106,34 +136,55 @@ public:
 		return --tmp;
 	}
 
-	template <typename Ty1>
-	friend bool operator==(const _avl_tree_const_iterator<Ty1> &, const _avl_tree_const_iterator<Ty1> &);
+	template <typename Traits1>
+	friend bool operator==(const _avl_tree_const_iterator<Traits1> &, const _avl_tree_const_iterator<Traits1> &);
 
 private:
 	_node *_ptr;
 	bool _is_end = false;
-}; // class _avl
+}; // class _avl_tree_const_iterator<>
 
-template <typename Ty>
-bool operator==(const _avl_tree_const_iterator<Ty> &left, const _avl_tree_const_iterator<Ty> &right)
+template <typename Traits>
+bool operator==(const _avl_tree_const_iterator<Traits> &left, const _avl_tree_const_iterator<Traits> &right)
 {
 	return left._ptr == right._ptr && left._is_end == right._is_end;
 }
 
-template <typename Ty>
-bool operator!=(const _avl_tree_const_iterator<Ty> &left, const _avl_tree_const_iterator<Ty> &right)
+template <typename Traits>
+bool operator!=(const _avl_tree_const_iterator<Traits> &left, const _avl_tree_const_iterator<Traits> &right)
 {
 	return !(left == right);
 }
 
-// AVL 树
-template <typename Ty>
-class avl_tree
+// 区间视图，用于范围 for 遍历 [first, last)
+template <typename Traits>
+struct _avl_tree_range
+{
+	_avl_tree_const_iterator<Traits> first, last;
+
+	[[nodiscard]] _avl_tree_const_iterator<Traits> begin() const
+	{
+		return first;
+	}
+	[[nodiscard]] _avl_tree_const_iterator<Traits> end() const
+	{
+		return last;
+	}
+};
+
+// AVL 树的公共实现
+// 按 Traits::_kfn 取得的关键字排序，avl_tree 与 avl_map 均以此为基础
+// Traits::_augment_type 非空时作为节点的基类，结构变化后由 Traits::_update 自底向上维护
+// 附加数据依赖祖先时（Traits::_top_down 为真），改由 Traits 在三处维护：
+// _linked 在新节点链接后、平衡修正前调用，_unlinking 在摘除节点前调用，_rotated 在每次旋转后调用
+template <typename Traits>
+class _avl_tree
 {
-	friend class _avl_tree_const_iterator<Ty>;
+	friend class _avl_tree_const_iterator<Traits>;
 
 public:
-	using value_type = Ty;
+	using key_type = typename Traits::key_type;
+	using value_type = typename Traits::value_type;
 
 	using size_type = size_t;
 	using difference_type = ptrdiff_t;
@@ -143,12 +194,12 @@ public:
 	using const_pointer = const value_type *;
 	using const_reference = const value_type &;
 
-	using iterator = _avl_tree_const_iterator<Ty>;
+	using iterator = _avl_tree_const_iterator<Traits>;
 	using const_iterator = iterator;
 
-private:
+protected:
 	// 二叉树节点
-	struct _node
+	struct _node : Traits::_augment_type
 	{
 		value_type data;
 		int bf{}; // 平衡因子
@@ -158,22 +209,25 @@ private:
 		_node *right = nullptr;	 // 右子树
 	};
 
-public: // 构造函数
-	avl_tree()
-	{
-	}
+	static constexpr bool _augmented = !std::is_empty_v<typename Traits::_augment_type>;
+	static constexpr bool _top_down = _avl_tree_top_down<Traits>::value;
 
-	template <typename InputIt>
-	avl_tree(InputIt first, InputIt last)
+	// search_many 中同时进行的查找数
+	static constexpr size_type _search_batch = 16;
+
+	_avl_tree() = default;
+
+	template <typename... Args>
+	static _node *_new_node(Args &&... args)
 	{
-		for (; first != last; ++first)
-			operator[](*first);
+		return new _node{{}, value_type(std::forward<Args>(args)...)};
 	}
 
-	avl_tree(const avl_tree &) = delete;
-	avl_tree(avl_tree &&) = delete;
-	avl_tree &operator=(const avl_tree &) = delete;
-	avl_tree &operator=(avl_tree &&) = delete;
+public:
+	_avl_tree(const _avl_tree &) = delete;
+	_avl_tree(_avl_tree &&) = delete;
+	_avl_tree &operator=(const _avl_tree &) = delete;
+	_avl_tree &operator=(_avl_tree &&) = delete;
 
 private:
 	// 用于在析构时释放内存
@@ -189,12 +243,41 @@ private:
 	}
 
 public:
-	~avl_tree()
+	~_avl_tree()
 	{
 		_free_node(_root);
 	}
 
 private:
+	// 根据孩子重新计算节点的附加数据
+	static void _update(_node *node)
+	{
+		if constexpr (_augmented && !_top_down)
+			Traits::_update(node);
+	}
+
+	// 从 node 开始向上更新至根
+	static void _update_path(_node *node)
+	{
+		if constexpr (_augmented && !_top_down)
+		{
+			for (; node; node = node->parent)
+				Traits::_update(node);
+		}
+	}
+
+	// 旋转后维护附加数据，child 为原来的子树根，top 为新的子树根
+	static void _rotated(_node *child, _node *top)
+	{
+		if constexpr (_top_down)
+			Traits::_rotated(child, top);
+		else
+		{
+			_update(child);
+			_update(top);
+		}
+	}
+
 	// 左旋
 	void _left_rotate(_node *node)
 	{
@@ -215,6 +298,8 @@ private:
 			r->left->parent = node;
 		r->left = node;
 		node->parent = r;
+
+		_rotated(node, r);
 	}
 	// 右旋
 	void _right_rotate(_node *node)
@@ -236,271 +321,648 @@ private:
 			l->right->parent = node;
 		l->right = node;
 		node->parent = l;
+
+		_rotated(node, l);
 	}
 
+	// 平衡修正的适配器，见 _avl_balance.hpp
+	struct _balance_ops
+	{
+		using handle = _node *;
+
+		_avl_tree *tree;
+
+		static bool is_null(const _node *node) noexcept
+		{
+			return !node;
+		}
+		static _node *parent(const _node *node) noexcept
+		{
+			return node->parent;
+		}
+		static _node *left(const _node *node) noexcept
+		{
+			return node->left;
+		}
+		static _node *right(const _node *node) noexcept
+		{
+			return node->right;
+		}
+		static int bf(const _node *node) noexcept
+		{
+			return node->bf;
+		}
+		static void set_bf(_node *node, int bf) noexcept
+		{
+			node->bf = bf;
+		}
+		void left_rotate(_node *node) const
+		{
+			tree->_left_rotate(node);
+		}
+		void right_rotate(_node *node) const
+		{
+			tree->_right_rotate(node);
+		}
+	};
+
 	// 插入后修正
 	void _insert_fix_up(_node *node)
 	{
-		while (true)
+		_avl_insert_fix_up(_balance_ops{this}, node);
+	}
+
+protected:
+	// 中序后继，不存在时返回 nullptr
+	static _node *_next(_node *node) noexcept
+	{
+		if (node->right)
 		{
-			_node *p = node->parent;
-			if (!p)
-				return;
+			for (node = node->right; node->left; node = node->left)
+				;
+			return node;
+		}
 
-			if (p->left == node)
-			{
-				switch (p->bf)
-				{
-				case -1:
-				{
-					p->bf = 0;
-					return;
-				}
-				case 0:
-				{
-					p->bf = 1;
-					node = p;
-					continue;
-				}
-				case 1:
-				{
-					if (node->bf == -1)
-						_left_rotate(node);
+		while (node->parent && node->parent->right == node)
+			node = node->parent;
+		return node->parent;
+	}
 
-					_right_rotate(p);
-					p->bf = 0;
-					node->bf = 0;
+	// 供派生类构造迭代器
+	static iterator _make_iter(_node *node, bool is_end = false) noexcept
+	{
+		return {node, is_end};
+	}
 
-					return;
-				}
-				default:
-					throw std::logic_error("预料之外的平衡因子值");
-				}
+	struct _find_insert_pos_return_type
+	{
+		_node *node;   // 已存在的节点，不存在时为 nullptr
+		_node *parent; // 插入位置的父节点
+		bool is_left;  // 是否插入为左孩子
+	};
+	// 查找关键字所在节点，不存在时返回插入位置
+	// 从 start 开始向下查找，key 必须落在 start 子树的范围内
+	_find_insert_pos_return_type _find_insert_pos(const key_type &key, _node *start) const
+	{
+		_node *p = start, *parent = start ? start->parent : nullptr;
+		bool is_left = parent && parent->left == start;
+		while (p)
+		{
+			const key_type &cur = Traits::_kfn(p->data);
+			if (cur < key)
+			{
+				parent = p;
+				is_left = false;
+				p = p->right;
 			}
-			else
+			else if (key < cur || Traits::_multi)
 			{
-				switch (p->bf)
-				{
-				case -1:
-				{
-					if (node->bf == 1)
-						_right_rotate(node);
-
-					_left_rotate(p);
-					p->bf = 0;
-					node->bf = 0;
-
-					return;
-				}
-				case 0:
-				{
-					p->bf = -1;
-					node = p;
-					continue;
-				}
-				case 1:
-				{
-					p->bf = 0;
-					return;
-				}
-				default:
-					throw std::logic_error("预料之外的平衡因子值");
-				}
+				// 允许重复时相等的关键字插入到右侧，保持插入顺序
+				parent = p;
+				is_left = key < cur;
+				p = is_left ? p->left : p->right;
 			}
+			else
+				return {p, p->parent, false};
 		}
+		return {nullptr, parent, is_left};
+	}
+	_find_insert_pos_return_type _find_insert_pos(const key_type &key) const
+	{
+		return _find_insert_pos(key, _root);
 	}
 
-public:
-	// 插入元素
-	value_type &operator[](const value_type &e)
+	// 从 hint 出发查找插入位置，只向上攀升到子树范围包含 key 的祖先为止
+	// 关键字位于 hint 附近时代价与两者的距离有关，而与树高无关
+	_find_insert_pos_return_type _find_insert_pos(const key_type &key, const_iterator hint) const
 	{
+		static_assert(!Traits::_multi, "仅支持关键字唯一的树");
+
 		if (!_root)
+			return {nullptr, nullptr, false};
+
+		// 追加到两端
+		if (Traits::_kfn(_rightmost->data) < key)
+			return {nullptr, _rightmost, false};
+		if (key < Traits::_kfn(_leftmost->data))
+			return {nullptr, _leftmost, true};
+
+		_node *p = hint._is_end ? _rightmost : hint._ptr;
+		assert(p);
+		const key_type &cur = Traits::_kfn(p->data);
+		if (!(cur < key) && !(key < cur))
+			return {p, p->parent, false};
+
+		// key 在 p 左侧时，向上找到第一个以右孩子身份到达且小于 key 的祖先
+		// key 在 p 右侧时与之对称
+		bool go_left = key < cur;
+		while (_node *parent = p->parent)
 		{
-			_root = new _node{e}; // 树为空
-			return _root->data;
+			if ((parent->right == p) == go_left)
+			{
+				const key_type &bound = Traits::_kfn(parent->data);
+				if (go_left ? bound < key : key < bound)
+					break;
+				if (!(bound < key) && !(key < bound))
+					return {parent, parent->parent, false};
+			}
+
+			p = parent;
 		}
 
+		return _find_insert_pos(key, p);
+	}
+
+	// 查找关键字所在节点，不存在时返回 nullptr
+	_node *_find_node(const key_type &key) const
+	{
 		_node *p = _root;
-		while (true)
+		while (p)
 		{
-			if (p->data == e)
-				return p->data;
-			else if (p->data < e)
-			{
-				if (p->right)
-					p = p->right;
-				else
-				{
-					p->right = new _node{e, 0, p};
-					_insert_fix_up(p->right);
-
-					return p->right->data;
-				}
-			}
+			const key_type &cur = Traits::_kfn(p->data);
+			if (cur < key)
+				p = p->right;
+			else if (key < cur)
+				p = p->left;
 			else
-			{
-				if (p->left)
-					p = p->left;
-				else
-				{
-					p->left = new _node{e, 0, p};
-					_insert_fix_up(p->left);
+				break;
+		}
+		return p;
+	}
 
-					return p->left->data;
-				}
-			}
+	// 将新节点链接到 _find_insert_pos 给出的位置并修正
+	_node *_link_node(_node *node, _node *parent, bool is_left)
+	{
+		node->parent = parent;
+		if (!parent)
+		{
+			_root = _leftmost = _rightmost = node; // 树为空
+		}
+		else
+		{
+			(is_left ? parent->left : parent->right) = node;
+			if (parent == _leftmost && is_left)
+				_leftmost = node;
+			else if (parent == _rightmost && !is_left)
+				_rightmost = node;
 		}
+
+		if constexpr (_top_down)
+			Traits::_linked(node);
+		if (parent)
+			_insert_fix_up(node);
+
+		_update_path(node);
+		++_size;
+		return node;
 	}
 
-	// 查找元素
-	[[nodiscard]] const_iterator search(const value_type &val)
+private:
+	// 删除后修正，is_left_child 表示 parent 的哪一侧高度降低
+	void _erase_fix_up(bool is_left_child, _node *parent)
 	{
-		if (!_root)
-			return end();
+		_avl_erase_fix_up(_balance_ops{this}, is_left_child, parent);
+	}
 
-		_node *p = _root;
-		while (p->data != val)
+	// 与中序后继交换在树中的位置，不移动节点中的数据
+	void _swap_with_successor(_node *node)
+	{
+		assert(node->left && node->right);
+
+		_node *succ = node->right;
+		while (succ->left)
+			succ = succ->left;
+
+		_node *parent = node->parent, *left = node->left, *right = node->right;
+		_node *succ_parent = succ->parent, *succ_right = succ->right;
+
+		(parent ? (parent->left == node ? parent->left : parent->right) : _root) = succ;
+		succ->parent = parent;
+		succ->left = left;
+		left->parent = succ;
+
+		if (succ_parent == node)
+		{
+			succ->right = node;
+			node->parent = succ;
+		}
+		else
+		{
+			succ->right = right;
+			right->parent = succ;
+			succ_parent->left = node;
+			node->parent = succ_parent;
+		}
+
+		node->left = nullptr;
+		node->right = succ_right;
+		if (succ_right)
+			succ_right->parent = node;
+
+		std::swap(node->bf, succ->bf);
+	}
+
+protected:
+	// 从树中摘除节点并修正，不释放内存
+	void _unlink_node(_node *node)
+	{
+		if constexpr (_top_down)
+			Traits::_unlinking(node);
+
+		// 最左和最右节点至多有一个孩子，不会被交换位置
+		if (node == _leftmost)
+			_leftmost = node->right ? node->right : node->parent;
+		if (node == _rightmost)
+			_rightmost = node->left ? node->left : node->parent;
+
+		if (node->left && node->right)
+			_swap_with_successor(node);
+
+		_node *parent = node->parent, *child = node->left ? node->left : node->right;
+		bool is_left_child = parent && parent->left == node;
+		(parent ? (is_left_child ? parent->left : parent->right) : _root) = child;
+		if (child)
+			child->parent = parent;
+
+		--_size;
+		if (parent)
+		{
+			_erase_fix_up(is_left_child, parent);
+			_update_path(parent);
+		}
+	}
+
+private:
+	// 将 n 个有序节点链接为完全平衡的子树，返回子树高度
+	int _build(_node **nodes, size_type n, _node *parent, _node *&root)
+	{
+		if (n == 0)
+		{
+			root = nullptr;
+			return 0;
+		}
+
+		size_type mid = n / 2;
+		_node *node = nodes[mid];
+		node->parent = parent;
+		int lh = _build(nodes, mid, node, node->left);
+		int rh = _build(nodes + mid + 1, n - mid - 1, node, node->right);
+		node->bf = lh - rh;
+		_update(node);
+
+		root = node;
+		return (lh > rh ? lh : rh) + 1;
+	}
+
+protected:
+	// 以按关键字有序的节点整体重建树，不做任何旋转
+	void _rebuild(std::vector<_node *> &nodes)
+	{
+		static_assert(!_top_down, "整体重建不维护依赖祖先的附加数据");
+
+		_build(nodes.data(), nodes.size(), nullptr, _root);
+		_leftmost = nodes.empty() ? nullptr : nodes.front();
+		_rightmost = nodes.empty() ? nullptr : nodes.back();
+		_size = nodes.size();
+	}
+
+private:
+	// 子树高度，沿较高的一侧下降，O(log n)
+	static int _height(_node *node) noexcept
+	{
+		int h = 0;
+		for (; node; ++h)
+			node = node->bf < 0 ? node->right : node->left;
+		return h;
+	}
+
+	// 以 k 连接高度分别为 lh、rh 的子树 l 与 r，l 中的关键字都小于 k，r 中的都大于 k
+	// 三者均已脱离树，返回新子树的根并把其高度写入 h，代价为 O(|lh - rh| + 1)
+	// 高度相差较大时，k 代替较高子树边缘上与较矮子树等高的节点 c，再按插入修正向上恢复平衡
+	// 脱离的子树没有父节点，修正中的旋转可能改写 _root，由调用者最后重新设置
+	_node *_join(_node *l, int lh, _node *k, _node *r, int rh, int &h)
+	{
+		k->parent = nullptr;
+		if (lh - rh <= 1 && rh - lh <= 1)
+		{
+			k->left = l;
+			k->right = r;
+			if (l)
+				l->parent = k;
+			if (r)
+				r->parent = k;
+			k->bf = lh - rh;
+			_update(k);
+
+			h = (lh > rh ? lh : rh) + 1;
+			return k;
+		}
+
+		bool left_taller = lh > rh;
+		_node *top = left_taller ? l : r;
+		int top_bf = top->bf;
+		int low = left_taller ? rh : lh;
+
+		// 沿较高子树朝向 k 的一侧下降，直到高度不超过 low + 1
+		_node *parent = nullptr, *c = top;
+		int ch = left_taller ? lh : rh;
+		while (ch > low + 1)
 		{
-			if (p->data < val)
+			parent = c;
+			if (left_taller)
 			{
-				if (p->right)
-					p = p->right;
-				else
-					return end();
+				ch -= c->bf == 1 ? 2 : 1;
+				c = c->right;
 			}
 			else
 			{
-				if (p->left)
-					p = p->left;
-				else
-					return end();
+				ch -= c->bf == -1 ? 2 : 1;
+				c = c->left;
 			}
 		}
-		return {p};
+
+		// c 的高度为 low 或 low + 1，k 代替 c 后该位置的高度恰好增加 1
+		if (left_taller)
+		{
+			k->left = c;
+			k->right = r;
+			k->bf = ch - low;
+			parent->right = k;
+		}
+		else
+		{
+			k->left = l;
+			k->right = c;
+			k->bf = low - ch;
+			parent->left = k;
+		}
+		k->parent = parent;
+		if (k->left)
+			k->left->parent = k;
+		if (k->right)
+			k->right->parent = k;
+		_update(k);
+
+		_insert_fix_up(k);
+		_update_path(k);
+
+		// 增高传到原来的根时整棵子树增高；根处发生旋转时高度不变，原来的根成为新根的孩子
+		h = (left_taller ? lh : rh) + (top_bf == 0 && top->bf != 0 && !top->parent ? 1 : 0);
+		return top->parent ? top->parent : top;
 	}
 
-private:
-	// 删除后修正
-	void _erase_fix_up(bool is_left_child, _node *parent)
+	// 把一个新节点插入高度为 h 的子树 node，返回新子树的根并更新 h，修正同 _join
+	_node *_union_one(_node *node, int &h, _node *new_node, size_type &dropped)
 	{
+		const key_type &key = Traits::_kfn(new_node->data);
+		_node *p = node;
 		while (true)
 		{
-			if (is_left_child)
+			const key_type &cur = Traits::_kfn(p->data);
+			bool is_left = key < cur;
+			if (!is_left && !(cur < key))
 			{
-				switch (parent->bf)
-				{
-				case -1:
-				{
-					_node *right = parent->right;
-					if (right->bf == 1)
-						_right_rotate(right);
+				delete new_node;
+				++dropped;
+				return node;
+			}
 
-					_left_rotate(parent);
-					parent->bf = -1;
-					right->bf = 1;
+			_node *&child = is_left ? p->left : p->right;
+			if (!child)
+			{
+				child = new_node;
+				new_node->parent = p;
+				break;
+			}
+			p = child;
+		}
 
-					return;
-				}
-				case 0:
-				{
-					parent->bf = -1;
-					return;
-				}
-				case 1:
-				{
-					parent->bf = 0;
+		int bf = node->bf;
+		_insert_fix_up(new_node);
+		_update_path(new_node);
 
-					_node *gp = parent->parent;
-					if (!gp)
-						return;
+		h += bf == 0 && node->bf != 0 && !node->parent ? 1 : 0;
+		return node->parent ? node->parent : node;
+	}
 
-					is_left_child = gp->left == parent;
-					parent = gp;
-					continue;
-				}
-				default:
-					throw std::logic_error("预料之外的平衡因子值");
-				}
-			}
-			else
-			{
-				switch (parent->bf)
-				{
-				case -1:
-				{
-					parent->bf = 0;
+	// 把 n 个有序且关键字互不相同的新节点并入高度为 h 的子树 node，返回新子树的根并更新 h
+	// 按 node 的关键字把新节点分为两段，分别递归并入左右子树后再以 node 连接，
+	// 只访问各插入位置查找路径的并集，两侧高度不变时连接只需 O(1)
+	// 关键字已存在的新节点被释放并计入 dropped
+	_node *_union(_node *node, int &h, _node **nodes, size_type n, size_type &dropped)
+	{
+		if (n == 0)
+			return node;
+		if (!node)
+		{
+			h = _build(nodes, n, nullptr, node);
+			return node;
+		}
 
-					_node *gp = parent->parent;
-					if (!gp)
-						return;
+		if (n == 1)
+			return _union_one(node, h, nodes[0], dropped);
 
-					is_left_child = gp->left == parent;
-					parent = gp;
-					continue;
-				}
-				case 0:
-				{
-					parent->bf = 1;
-					return;
-				}
-				case 1:
-				{
-					_node *left = parent->left;
-					assert(left);
-					if (left->bf == -1)
-						_left_rotate(left);
+		const key_type &key = Traits::_kfn(node->data);
+		size_type mid = static_cast<size_type>(
+			std::partition_point(nodes, nodes + n, [&key](_node *p) { return Traits::_kfn(p->data) < key; }) -
+			nodes);
+		bool found = mid < n && !(key < Traits::_kfn(nodes[mid]->data));
+		if (found)
+		{
+			delete nodes[mid];
+			++dropped;
+		}
 
-					_right_rotate(parent);
-					parent->bf = 1;
-					left->bf = -1;
+		_node *l = node->left, *r = node->right;
+		int lh = node->bf == -1 ? h - 2 : h - 1, rh = node->bf == 1 ? h - 2 : h - 1;
+		if (l)
+			l->parent = nullptr;
+		if (r)
+			r->parent = nullptr;
 
-					return;
-				}
-				default:
-					throw std::logic_error("预料之外的平衡因子值");
+		l = _union(l, lh, nodes, mid, dropped);
+		r = _union(r, rh, nodes + mid + found, n - mid - found, dropped);
+		return _join(l, lh, node, r, rh, h);
+	}
+
+protected:
+	// 把按关键字有序且互不相同的新节点一次并入树中，关键字已存在的节点被释放
+	// k 个节点并入 n 个节点的树代价为 O(k log(n / k + 1))，不逐个从根查找插入位置
+	void _insert_nodes(std::vector<_node *> &nodes)
+	{
+		static_assert(!Traits::_multi, "仅支持关键字唯一的树");
+		static_assert(!_top_down, "批量并入不维护依赖祖先的附加数据");
+
+		int h = _height(_root);
+		size_type dropped = 0;
+		_root = _union(_root, h, nodes.data(), nodes.size(), dropped);
+		_size += nodes.size() - dropped;
+
+		_leftmost = _rightmost = _root;
+		if (_root)
+		{
+			while (_leftmost->left)
+				_leftmost = _leftmost->left;
+			while (_rightmost->right)
+				_rightmost = _rightmost->right;
+		}
+	}
+
+public:
+	// 查找元素
+	[[nodiscard]] const_iterator search(const key_type &key)
+	{
+		_node *p = _find_node(key);
+		return p ? const_iterator{p} : end();
+	}
+
+	[[nodiscard]] bool contains(const key_type &key) const
+	{
+		return _find_node(key) != nullptr;
+	}
+
+	// 依次查找 [first, last) 中的每个关键字，把结果（不存在时为 end()）按顺序写入 out
+	// 每组 _search_batch 个查找轮流下降一层并预取各自的下一个节点，多个缓存缺失的等待互相重叠
+	template <typename ForwardIt, typename OutputIt>
+	OutputIt search_many(ForwardIt first, ForwardIt last, OutputIt out)
+	{
+		const key_type *keys[_search_batch];
+		_node *nodes[_search_batch];
+		while (first != last)
+		{
+			size_type n = 0;
+			for (; n < _search_batch && first != last; ++n, ++first)
+			{
+				keys[n] = std::addressof(*first);
+				nodes[n] = _root;
+			}
+
+			for (bool active = true; active;)
+			{
+				active = false;
+				for (size_type i = 0; i < n; ++i)
+				{
+					_node *p = nodes[i];
+					if (!p)
+						continue;
+
+					const key_type &cur = Traits::_kfn(p->data);
+					if (cur < *keys[i])
+						p = p->right;
+					else if (*keys[i] < cur)
+						p = p->left;
+					else
+						continue;
+
+					if (p)
+						_prefetch(p);
+					nodes[i] = p;
+					active = true;
 				}
 			}
+
+			for (size_type i = 0; i < n; ++i)
+				*out++ = nodes[i] ? const_iterator{nodes[i]} : end();
 		}
+		return out;
 	}
 
-public:
 	// 删除元素
-	bool erase(const value_type &val)
+	bool erase(const key_type &key)
 	{
-		const_iterator it = search(val);
-		if (it._ptr == nullptr)
+		_node *p = _find_node(key);
+		if (!p)
 			return false;
 
-		if (it._ptr->left && it._ptr->right)
+		_unlink_node(p);
+		delete p;
+		return true;
+	}
+
+	// 删除迭代器指向的元素，返回其后继
+	const_iterator erase(const_iterator it)
+	{
+		assert(!it._is_end);
+
+		_node *p = it._ptr;
+		bool is_last = (++it)._is_end;
+
+		_unlink_node(p);
+		delete p;
+		return is_last ? end() : it;
+	}
+
+	[[nodiscard]] size_type size() const noexcept
+	{
+		return _size;
+	}
+
+	[[nodiscard]] bool empty() const noexcept
+	{
+		return _size == 0;
+	}
+
+private:
+	// 第一个关键字不小于 key 的节点
+	_node *_lower_bound(const key_type &key) const
+	{
+		_node *p = _root, *result = nullptr;
+		while (p)
 		{
-			_node *p = it._ptr;
-			p->data = std::move(*++it);
+			if (Traits::_kfn(p->data) < key)
+				p = p->right;
+			else
+			{
+				result = p;
+				p = p->left;
+			}
 		}
+		return result;
+	}
 
-		_node *parent = it._ptr->parent;
-		if (_node *l = it._ptr->left)
+	// 第一个关键字大于 key 的节点
+	_node *_upper_bound(const key_type &key) const
+	{
+		_node *p = _root, *result = nullptr;
+		while (p)
 		{
-			(parent ? (parent->left == it._ptr ? parent->left : parent->right) : _root) = l;
-			if (l)
-				l->parent = parent;
-			delete it._ptr;
-
-			if (parent)
-				_erase_fix_up(parent->left == l, parent);
+			if (key < Traits::_kfn(p->data))
+			{
+				result = p;
+				p = p->left;
+			}
+			else
+				p = p->right;
 		}
-		else
-		{
-			_node *r = it._ptr->right;
-			(parent ? (parent->left == it._ptr ? parent->left : parent->right) : _root) = r;
-			if (r)
-				r->parent = parent;
-			delete it._ptr;
+		return result;
+	}
 
-			if (parent)
-				_erase_fix_up(parent->left == r, parent);
-		}
+public:
+	// 有序查询
+	[[nodiscard]] iterator lower_bound(const key_type &key)
+	{
+		_node *p = _lower_bound(key);
+		return p ? iterator{p} : end();
+	}
 
-		return true;
+	[[nodiscard]] iterator upper_bound(const key_type &key)
+	{
+		_node *p = _upper_bound(key);
+		return p ? iterator{p} : end();
+	}
+
+	[[nodiscard]] std::pair<iterator, iterator> equal_range(const key_type &key)
+	{
+		return {lower_bound(key), upper_bound(key)};
+	}
+
+	// 关键字位于 [first, last) 中的所有元素
+	[[nodiscard]] _avl_tree_range<Traits> range(const key_type &first, const key_type &last)
+	{
+		if (!(first < last))
+			return {end(), end()};
+
+		return {lower_bound(first), lower_bound(last)};
 	}
 
 	// 迭代器
@@ -509,25 +971,176 @@ public:
 		if (!_root)
 			return {nullptr, true};
 
-		_node *p = _root;
-		for (; p->left; p = p->left)
-			;
-		return {p};
+		return {_leftmost};
 	}
 
 	[[nodiscard]] iterator end()
 	{
-		if (!_root)
-			return {nullptr, true};
+		return {_rightmost, true};
+	}
 
-		_node *p = _root;
-		for (; p->right; p = p->right)
-			;
-		return {p, true};
+protected:
+	_node *_root = nullptr;		 // 根节点
+	_node *_leftmost = nullptr;	 // 最小节点
+	_node *_rightmost = nullptr; // 最大节点
+	size_type _size = 0;		 // 元素数量
+};							// class _avl_tree<>
+
+// AVL 树
+template <typename Ty>
+class avl_tree : public _avl_tree<_avl_tree_traits<Ty>>
+{
+	using _base = _avl_tree<_avl_tree_traits<Ty>>;
+	using typename _base::_node;
+
+public: // 构造函数
+	avl_tree()
+	{
+	}
+
+	template <typename InputIt>
+	avl_tree(InputIt first, InputIt last)
+	{
+		for (; first != last; ++first)
+			insert(this->end(), *first);
+	}
+
+	// 由 save() 写出的快照建立，O(n)，快照损坏时抛出 std::runtime_error
+	explicit avl_tree(std::istream &in)
+	{
+		std::vector<Ty> sorted = _load_snapshot<Ty>(in);
+		auto at = [&sorted](size_t i) -> const Ty & { return sorted[i]; };
+		_check_snapshot_order<Ty>(sorted.size(), at, true);
+		_build_from_sorted(sorted.size(), at);
+	}
+
+	// 由内存中的快照建立，例如映射到内存的快照文件，元素直接从 data 复制到节点
+	avl_tree(const void *data, size_t size)
+	{
+		_snapshot_view<Ty> view(data, size);
+		auto at = [&view](size_t i) { return view[i]; };
+		_check_snapshot_order<Ty>(view.size(), at, true);
+		_build_from_sorted(view.size(), at);
 	}
 
 private:
-	_node *_root = nullptr; // 根节点
-};							// class avl_tree<>
+	// 以升序的元素 value_at(0), ..., value_at(n - 1) 整体建立，树必须为空
+	template <typename Fn>
+	void _build_from_sorted(size_t n, Fn value_at)
+	{
+		std::vector<_node *> nodes;
+		nodes.reserve(n);
+		try
+		{
+			for (size_t i = 0; i < n; ++i)
+				nodes.push_back(this->_new_node(value_at(i)));
+		}
+		catch (...)
+		{
+			for (_node *node : nodes)
+				delete node;
+			throw;
+		}
+
+		this->_rebuild(nodes);
+	}
+
+public:
+	// 插入元素
+	typename _base::value_type &operator[](const typename _base::value_type &e)
+	{
+		auto [node, parent, is_left] = this->_find_insert_pos(e);
+		if (node)
+			return node->data;
+
+		return this->_link_node(this->_new_node(e), parent, is_left)->data;
+	}
+
+	// 以 hint 为起点插入元素，返回指向该元素的迭代器
+	// 输入接近有序时，以上一次插入的位置或 end() 作为 hint 可避免从根开始查找
+	typename _base::iterator insert(typename _base::const_iterator hint, const typename _base::value_type &e)
+	{
+		auto [node, parent, is_left] = this->_find_insert_pos(e, hint);
+		if (!node)
+			node = this->_link_node(this->_new_node(e), parent, is_left);
+
+		return this->_make_iter(node);
+	}
+
+	// 批量插入已排序的元素
+	// 批量相对于树较大时与现有节点归并后整体重建，O(n + k)；
+	// 否则把整批元素沿各自的查找路径一次并入，自底向上逐层连接，O(k log(n / k + 1))
+	template <typename ForwardIt>
+	void insert_sorted(ForwardIt first, ForwardIt last)
+	{
+		assert(std::is_sorted(first, last));
+
+		size_t count = static_cast<size_t>(std::distance(first, last));
+		if (count * 4 < this->size())
+		{
+			std::vector<_node *> nodes;
+			nodes.reserve(count);
+			try
+			{
+				for (; first != last; ++first)
+				{
+					if (nodes.empty() || nodes.back()->data < *first)
+						nodes.push_back(this->_new_node(*first));
+				}
+			}
+			catch (...)
+			{
+				for (_node *node : nodes)
+					delete node;
+				throw;
+			}
+
+			this->_insert_nodes(nodes);
+			return;
+		}
+
+		std::vector<_node *> nodes;
+		nodes.reserve(this->size() + count);
+		try
+		{
+			_node *p = this->_leftmost;
+			for (; first != last; ++first)
+			{
+				for (; p && p->data < *first; p = _base::_next(p))
+					nodes.push_back(p);
+
+				if ((p && !(*first < p->data)) || (!nodes.empty() && !(nodes.back()->data < *first)))
+					continue; // 已存在
+
+				nodes.push_back(this->_new_node(*first));
+			}
+			for (; p; p = _base::_next(p))
+				nodes.push_back(p);
+		}
+		catch (...)
+		{
+			for (_node *node : nodes)
+			{
+				if (!node->parent && node != this->_root)
+					delete node; // 新分配的节点尚未链接，父节点为空
+			}
+			throw;
+		}
+
+		this->_rebuild(nodes);
+	}
+
+	// 按升序把所有元素写成带校验和的二进制快照，元素类型须可平凡复制
+	// 快照可由 avl_tree(std::istream &) 或 avl_tree(const void *, size_t) 以 O(n) 读回
+	void save(std::ostream &out) const
+	{
+		_node *p = this->_leftmost;
+		_save_snapshot<Ty>(out, this->size(), [&p]() -> const Ty & {
+			const Ty &e = p->data;
+			p = _base::_next(p);
+			return e;
+		});
+	}
+}; // class avl_tree<>
 
 } // namespace ds
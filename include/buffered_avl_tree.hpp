@@ -0,0 +1,170 @@
+﻿// buffered_avl_tree.hpp : 延迟平衡的 AVL 树
+//
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "avl_tree.hpp"
+
+namespace ds
+{
+
+// 延迟平衡的 AVL 树
+// 新元素先进入缓冲区，缓冲区达到阈值或调用 flush 时再由 avl_tree::insert_sorted 一次并入树中，
+// 插入既不查找树也不做旋转，与树中已有元素重复的缓冲元素在并入时丢弃。
+// 缓冲区由有序部分和至多 _tail_capacity 个元素的无序尾部组成，尾部满时排序后归并进有序部分，
+// 插入的均摊代价为 O(log t + t / _tail_capacity)。查找同时检查树和缓冲区，任何时候结果都正确
+template <typename Ty>
+class buffered_avl_tree
+{
+public:
+    using value_type = Ty;
+
+    using size_type = size_t;
+
+    using iterator = typename avl_tree<Ty>::iterator;
+    using const_iterator = iterator;
+
+private:
+    static constexpr size_type _tail_capacity = 32;
+
+public: // 构造函数
+    explicit buffered_avl_tree(size_type threshold = 1024) : _threshold(threshold)
+    {
+        _buffer.reserve(threshold);
+        _tail.reserve(_tail_capacity);
+    }
+
+    template <typename InputIt>
+    buffered_avl_tree(InputIt first, InputIt last, size_type threshold = 1024) : buffered_avl_tree(threshold)
+    {
+        for (; first != last; ++first)
+            insert(*first);
+        flush();
+    }
+
+    buffered_avl_tree(const buffered_avl_tree &) = delete;
+    buffered_avl_tree(buffered_avl_tree &&) = delete;
+    buffered_avl_tree &operator=(const buffered_avl_tree &) = delete;
+    buffered_avl_tree &operator=(buffered_avl_tree &&) = delete;
+
+private:
+    // 无序尾部中与 val 相等的元素
+    typename std::vector<Ty>::iterator _find_in_tail(const value_type &val)
+    {
+        return std::find_if(_tail.begin(), _tail.end(), [&val](const value_type &e) { return !(e < val) && !(val < e); });
+    }
+
+    [[nodiscard]] bool _buffered(const value_type &val) const
+    {
+        return std::binary_search(_buffer.begin(), _buffer.end(), val) ||
+               std::any_of(_tail.begin(), _tail.end(), [&val](const value_type &e) { return !(e < val) && !(val < e); });
+    }
+
+    // 把尾部排序后归并进有序部分
+    void _merge_tail()
+    {
+        std::sort(_tail.begin(), _tail.end());
+        size_type mid = _buffer.size();
+        _buffer.insert(_buffer.end(), _tail.begin(), _tail.end());
+        std::inplace_merge(_buffer.begin(), _buffer.begin() + mid, _buffer.end());
+        _tail.clear();
+    }
+
+public:
+    // 插入元素，与树中已有元素重复时在并入时丢弃
+    void insert(const value_type &val)
+    {
+        if (_buffered(val))
+            return;
+
+        _tail.push_back(val);
+        if (_tail.size() >= _tail_capacity)
+            _merge_tail();
+
+        if (pending() >= _threshold)
+            flush();
+    }
+
+    // 将缓冲区并入树中
+    void flush()
+    {
+        if (pending() == 0)
+            return;
+
+        _merge_tail();
+        _tree.insert_sorted(_buffer.begin(), _buffer.end());
+        _buffer.clear();
+    }
+
+    [[nodiscard]] bool contains(const value_type &val) const
+    {
+        return _tree.contains(val) || _buffered(val);
+    }
+
+    // 删除元素，缓冲区与树中可能各有一份，都要删除
+    bool erase(const value_type &val)
+    {
+        bool erased = false;
+        auto it = std::lower_bound(_buffer.begin(), _buffer.end(), val);
+        if (it != _buffer.end() && !(val < *it))
+        {
+            _buffer.erase(it);
+            erased = true;
+        }
+        else if (auto tail_it = _find_in_tail(val); tail_it != _tail.end())
+        {
+            *tail_it = std::move(_tail.back());
+            _tail.pop_back();
+            erased = true;
+        }
+
+        return _tree.erase(val) || erased;
+    }
+
+    // 元素数量，不并入缓冲区
+    // 缓冲区内部没有重复，只需去掉与树中重复的元素，代价为 O(pending() log n)
+    [[nodiscard]] size_type size() const
+    {
+        size_type count = _tree.size();
+        for (const value_type &val : _buffer)
+            count += !_tree.contains(val);
+        for (const value_type &val : _tail)
+            count += !_tree.contains(val);
+        return count;
+    }
+
+    [[nodiscard]] bool empty() const noexcept
+    {
+        return _tree.empty() && pending() == 0;
+    }
+
+    // 尚未并入树中的元素数量，可能包含与树中重复的元素
+    [[nodiscard]] size_type pending() const noexcept
+    {
+        return _buffer.size() + _tail.size();
+    }
+
+    // 迭代器，获取前先并入缓冲区
+    [[nodiscard]] iterator begin()
+    {
+        flush();
+        return _tree.begin();
+    }
+
+    [[nodiscard]] iterator end()
+    {
+        flush();
+        return _tree.end();
+    }
+
+private:
+    avl_tree<Ty> _tree;
+    std::vector<Ty> _buffer; // 缓冲区的有序部分
+    std::vector<Ty> _tail;   // 缓冲区的无序尾部，与有序部分不重复
+    size_type _threshold;    // 缓冲区容量
+};                           // class buffered_avl_tree<>
+
+} // namespace ds
@@ -0,0 +1,574 @@
+﻿// compact_avl_tree.hpp : 紧凑存储的 AVL 树
+//
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "_avl_balance.hpp"
+
+namespace ds
+{
+
+template <typename Ty>
+class compact_avl_tree;
+
+// 迭代器
+template <typename Ty>
+class _compact_avl_tree_const_iterator
+{
+    friend class compact_avl_tree<Ty>;
+
+public:
+    using iterator_category = std::bidirectional_iterator_tag;
+
+    using value_type = Ty;
+    using difference_type = ptrdiff_t;
+    using pointer = const value_type *;
+    using reference = const value_type &;
+
+private:
+    using _tree = compact_avl_tree<Ty>;
+    using _index = typename _tree::_index;
+
+    _compact_avl_tree_const_iterator(const _tree *tree, _index index) : _tree_ptr(tree), _cur(index) {}
+
+public:
+    // 解引用
+    [[nodiscard]] reference operator*() const
+    {
+        assert(_cur != _tree::_nil);
+        return _tree_ptr->_at(_cur).data;
+    }
+    [[nodiscard]] pointer operator->() const
+    {
+        assert(_cur != _tree::_nil);
+        return &_tree_ptr->_at(_cur).data;
+    }
+
+    // 自增
+    _compact_avl_tree_const_iterator &operator++()
+    {
+        assert(_cur != _tree::_nil);
+        _cur = _tree_ptr->_next(_cur);
+        return *this;
+    }
+    _compact_avl_tree_const_iterator operator++(int)
+    {
+        auto tmp = *this;
+        ++*this;
+        return tmp;
+    }
+
+    // 自减
+    _compact_avl_tree_const_iterator &operator--()
+    {
+        _cur = _cur == _tree::_nil ? _tree_ptr->_rightmost() : _tree_ptr->_prev(_cur);
+        assert(_cur != _tree::_nil);
+        return *this;
+    }
+    _compact_avl_tree_const_iterator operator--(int)
+    {
+        auto tmp = *this;
+        --*this;
+        return tmp;
+    }
+
+    friend bool operator==(const _compact_avl_tree_const_iterator &left, const _compact_avl_tree_const_iterator &right)
+    {
+        return left._cur == right._cur;
+    }
+    friend bool operator!=(const _compact_avl_tree_const_iterator &left, const _compact_avl_tree_const_iterator &right)
+    {
+        return !(left == right);
+    }
+
+private:
+    const _tree *_tree_ptr;
+    _index _cur; // 尾后为 _nil
+}; // class _compact_avl_tree_const_iterator<>
+
+// 紧凑存储的 AVL 树
+// 节点连续存放在固定大小的块中，以 32 位下标代替指针相互链接，
+// 平衡因子存放在父节点下标的高 2 位。删除的节点进入空闲链表，析构时整块释放
+template <typename Ty>
+class compact_avl_tree
+{
+    friend class _compact_avl_tree_const_iterator<Ty>;
+
+public:
+    using value_type = Ty;
+
+    using size_type = size_t;
+    using difference_type = ptrdiff_t;
+
+    using pointer = value_type *;
+    using reference = value_type &;
+    using const_pointer = const value_type *;
+    using const_reference = const value_type &;
+
+    using iterator = _compact_avl_tree_const_iterator<Ty>;
+    using const_iterator = iterator;
+
+private:
+    using _index = uint32_t;
+
+    static constexpr _index _nil = (_index(1) << 30) - 1; // 空下标
+    static constexpr size_t _slab_shift = 10;             // 每块 1024 个节点
+    static constexpr _index _slab_mask = (_index(1) << _slab_shift) - 1;
+
+    // 二叉树节点
+    struct _node
+    {
+        value_type data;
+        _index parent_bf; // 低 30 位为父节点下标，高 2 位为平衡因子 + 1
+        _index left;      // 左子树
+        _index right;     // 右子树
+    };
+
+    // 节点槽位，空闲时存放空闲链表的下一项
+    union _slot
+    {
+        _slot() {}
+        ~_slot() {}
+
+        _node node;
+        _index next_free;
+    };
+
+public: // 构造函数
+    compact_avl_tree()
+    {
+    }
+
+    template <typename InputIt>
+    compact_avl_tree(InputIt first, InputIt last)
+    {
+        for (; first != last; ++first)
+            operator[](*first);
+    }
+
+    compact_avl_tree(const compact_avl_tree &) = delete;
+    compact_avl_tree(compact_avl_tree &&) = delete;
+    compact_avl_tree &operator=(const compact_avl_tree &) = delete;
+    compact_avl_tree &operator=(compact_avl_tree &&) = delete;
+
+    ~compact_avl_tree()
+    {
+        // 平凡析构的元素无需逐个访问
+        if constexpr (!std::is_trivially_destructible_v<value_type>)
+        {
+            for (_index i = _leftmost(); i != _nil; i = _next(i))
+                _at(i).data.~value_type();
+        }
+
+        for (_slot *slab : _slabs)
+            delete[] slab;
+    }
+
+private:
+    // 按下标访问节点
+    _slot &_slot_at(_index i) const noexcept
+    {
+        return _slabs[i >> _slab_shift][i & _slab_mask];
+    }
+    _node &_at(_index i) const noexcept
+    {
+        assert(i != _nil);
+        return _slot_at(i).node;
+    }
+
+    _index _parent(_index i) const noexcept
+    {
+        return _at(i).parent_bf & _nil;
+    }
+    void _set_parent(_index i, _index parent) noexcept
+    {
+        _index &pb = _at(i).parent_bf;
+        pb = (pb & ~_nil) | parent;
+    }
+    int _bf(_index i) const noexcept
+    {
+        return int(_at(i).parent_bf >> 30) - 1;
+    }
+    void _set_bf(_index i, int bf) noexcept
+    {
+        assert(bf >= -1 && bf <= 1);
+        _index &pb = _at(i).parent_bf;
+        pb = (pb & _nil) | (_index(bf + 1) << 30);
+    }
+
+    // 分配节点，优先复用空闲链表
+    _index _new_node(const value_type &val, _index parent)
+    {
+        _index i;
+        if (_free != _nil)
+        {
+            i = _free;
+            _free = _slot_at(i).next_free;
+        }
+        else
+        {
+            // _nil 本身不能作为下标，且未必落在块的边界上
+            if (_used == _nil)
+                throw std::length_error("节点数量超出下标范围");
+            if ((_used & _slab_mask) == 0)
+            {
+                // push_back 抛出异常时由 unique_ptr 释放新块
+                std::unique_ptr<_slot[]> slab(new _slot[size_t(1) << _slab_shift]);
+                _slabs.push_back(slab.get());
+                slab.release();
+            }
+            i = _used++;
+        }
+
+        _slot &slot = _slot_at(i);
+        try
+        {
+            new (&slot.node) _node{val, parent | (_index(1) << 30), _nil, _nil};
+        }
+        catch (...)
+        {
+            slot.next_free = _free;
+            _free = i;
+            throw;
+        }
+        return i;
+    }
+
+    // 释放节点，槽位进入空闲链表
+    void _delete_node(_index i)
+    {
+        _slot &slot = _slot_at(i);
+        slot.node.~_node();
+        slot.next_free = _free;
+        _free = i;
+    }
+
+    // 中序遍历
+    _index _leftmost() const noexcept
+    {
+        _index i = _root;
+        if (i != _nil)
+        {
+            while (_at(i).left != _nil)
+                i = _at(i).left;
+        }
+        return i;
+    }
+    _index _rightmost() const noexcept
+    {
+        _index i = _root;
+        if (i != _nil)
+        {
+            while (_at(i).right != _nil)
+                i = _at(i).right;
+        }
+        return i;
+    }
+    _index _next(_index i) const noexcept
+    {
+        if (_at(i).right != _nil)
+        {
+            for (i = _at(i).right; _at(i).left != _nil; i = _at(i).left)
+                ;
+            return i;
+        }
+
+        _index p = _parent(i);
+        while (p != _nil && _at(p).right == i)
+        {
+            i = p;
+            p = _parent(i);
+        }
+        return p;
+    }
+    _index _prev(_index i) const noexcept
+    {
+        if (_at(i).left != _nil)
+        {
+            for (i = _at(i).left; _at(i).right != _nil; i = _at(i).right)
+                ;
+            return i;
+        }
+
+        _index p = _parent(i);
+        while (p != _nil && _at(p).left == i)
+        {
+            i = p;
+            p = _parent(i);
+        }
+        return p;
+    }
+
+    // 将 parent 指向 old_child 的链接改为 new_child
+    void _replace_child(_index parent, _index old_child, _index new_child) noexcept
+    {
+        if (parent == _nil)
+            _root = new_child;
+        else if (_at(parent).left == old_child)
+            _at(parent).left = new_child;
+        else
+            _at(parent).right = new_child;
+    }
+
+    // 左旋
+    void _left_rotate(_index node)
+    {
+        _index p = _parent(node), r = _at(node).right;
+        assert(r != _nil);
+        _replace_child(p, node, r);
+        _set_parent(r, p);
+        _index rl = _at(r).left;
+        _at(node).right = rl;
+        if (rl != _nil)
+            _set_parent(rl, node);
+        _at(r).left = node;
+        _set_parent(node, r);
+    }
+    // 右旋
+    void _right_rotate(_index node)
+    {
+        _index p = _parent(node), l = _at(node).left;
+        assert(l != _nil);
+        _replace_child(p, node, l);
+        _set_parent(l, p);
+        _index lr = _at(l).right;
+        _at(node).left = lr;
+        if (lr != _nil)
+            _set_parent(lr, node);
+        _at(l).right = node;
+        _set_parent(node, l);
+    }
+
+    // 平衡修正的适配器，见 _avl_balance.hpp
+    struct _balance_ops
+    {
+        using handle = _index;
+
+        compact_avl_tree *tree;
+
+        static bool is_null(_index i) noexcept
+        {
+            return i == _nil;
+        }
+        _index parent(_index i) const noexcept
+        {
+            return tree->_parent(i);
+        }
+        _index left(_index i) const noexcept
+        {
+            return tree->_at(i).left;
+        }
+        _index right(_index i) const noexcept
+        {
+            return tree->_at(i).right;
+        }
+        int bf(_index i) const noexcept
+        {
+            return tree->_bf(i);
+        }
+        void set_bf(_index i, int bf) const noexcept
+        {
+            tree->_set_bf(i, bf);
+        }
+        void left_rotate(_index i) const
+        {
+            tree->_left_rotate(i);
+        }
+        void right_rotate(_index i) const
+        {
+            tree->_right_rotate(i);
+        }
+    };
+
+    // 插入后修正
+    void _insert_fix_up(_index node)
+    {
+        _avl_insert_fix_up(_balance_ops{this}, node);
+    }
+
+    // 删除后修正，is_left_child 表示 parent 的哪一侧高度降低
+    void _erase_fix_up(bool is_left_child, _index parent)
+    {
+        _avl_erase_fix_up(_balance_ops{this}, is_left_child, parent);
+    }
+
+    // 与中序后继交换在树中的位置，不移动节点中的数据
+    void _swap_with_successor(_index node)
+    {
+        _index succ = _at(node).right;
+        while (_at(succ).left != _nil)
+            succ = _at(succ).left;
+
+        _index parent = _parent(node), left = _at(node).left, right = _at(node).right;
+        _index succ_parent = _parent(succ), succ_right = _at(succ).right;
+        int bf = _bf(node), succ_bf = _bf(succ);
+
+        _replace_child(parent, node, succ);
+        _set_parent(succ, parent);
+        _at(succ).left = left;
+        _set_parent(left, succ);
+
+        if (succ_parent == node)
+        {
+            _at(succ).right = node;
+            _set_parent(node, succ);
+        }
+        else
+        {
+            _at(succ).right = right;
+            _set_parent(right, succ);
+            _at(succ_parent).left = node;
+            _set_parent(node, succ_parent);
+        }
+
+        _at(node).left = _nil;
+        _at(node).right = succ_right;
+        if (succ_right != _nil)
+            _set_parent(succ_right, node);
+
+        _set_bf(node, succ_bf);
+        _set_bf(succ, bf);
+    }
+
+    // 摘除并释放节点
+    void _erase_node(_index node)
+    {
+        if (_at(node).left != _nil && _at(node).right != _nil)
+            _swap_with_successor(node);
+
+        _index parent = _parent(node);
+        _index child = _at(node).left != _nil ? _at(node).left : _at(node).right;
+        bool is_left_child = parent != _nil && _at(parent).left == node;
+        _replace_child(parent, node, child);
+        if (child != _nil)
+            _set_parent(child, parent);
+
+        _delete_node(node);
+        --_size;
+
+        if (parent != _nil)
+            _erase_fix_up(is_left_child, parent);
+    }
+
+    _index _find_node(const value_type &val) const
+    {
+        _index p = _root;
+        while (p != _nil)
+        {
+            const value_type &cur = _at(p).data;
+            if (cur < val)
+                p = _at(p).right;
+            else if (val < cur)
+                p = _at(p).left;
+            else
+                break;
+        }
+        return p;
+    }
+
+public:
+    // 插入元素
+    value_type &operator[](const value_type &e)
+    {
+        if (_root == _nil)
+        {
+            _root = _new_node(e, _nil); // 树为空
+            ++_size;
+            return _at(_root).data;
+        }
+
+        _index p = _root;
+        while (true)
+        {
+            const value_type &cur = _at(p).data;
+            bool is_left = e < cur;
+            if (!is_left && !(cur < e))
+                return _at(p).data;
+
+            _index child = is_left ? _at(p).left : _at(p).right;
+            if (child != _nil)
+            {
+                p = child;
+                continue;
+            }
+
+            child = _new_node(e, p);
+            (is_left ? _at(p).left : _at(p).right) = child;
+            ++_size;
+            _insert_fix_up(child);
+            return _at(child).data;
+        }
+    }
+
+    // 查找元素
+    [[nodiscard]] const_iterator search(const value_type &val) const
+    {
+        return {this, _find_node(val)};
+    }
+
+    // 删除元素
+    bool erase(const value_type &val)
+    {
+        _index p = _find_node(val);
+        if (p == _nil)
+            return false;
+
+        _erase_node(p);
+        return true;
+    }
+
+    // 删除迭代器指向的元素，返回其后继
+    const_iterator erase(const_iterator it)
+    {
+        assert(it._cur != _nil);
+
+        _index next = _next(it._cur);
+        _erase_node(it._cur);
+        return {this, next};
+    }
+
+    [[nodiscard]] size_type size() const noexcept
+    {
+        return _size;
+    }
+
+    [[nodiscard]] bool empty() const noexcept
+    {
+        return _size == 0;
+    }
+
+    // 已分配的字节数，包括空闲槽位
+    [[nodiscard]] size_type memory_usage() const noexcept
+    {
+        return _slabs.size() * (sizeof(_slot) << _slab_shift) + _slabs.capacity() * sizeof(_slot *);
+    }
+
+    // 迭代器
+    [[nodiscard]] iterator begin() const
+    {
+        return {this, _leftmost()};
+    }
+
+    [[nodiscard]] iterator end() const
+    {
+        return {this, _nil};
+    }
+
+private:
+    std::vector<_slot *> _slabs; // 节点块
+    _index _root = _nil;         // 根节点
+    _index _free = _nil;         // 空闲链表
+    _index _used = 0;            // 已使用过的槽位数
+    size_type _size = 0;         // 元素数量
+};                               // class compact_avl_tree<>
+
+} // namespace ds
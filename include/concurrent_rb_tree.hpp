@@ -0,0 +1,268 @@
+﻿// concurrent_rb_tree.hpp : 读者无锁的并发红黑树
+//
+
+#pragma once
+
+#include <cstdint>
+#include <utility>
+
+#include "_versioned_tree.hpp"
+
+namespace ds
+{
+
+// 并发红黑树的节点
+template <typename Ty>
+struct _concurrent_rb_tree_node
+{
+    Ty data;
+    uint64_t stamp; // 创建该节点的修改序号，与当前序号相同时可原地修改
+    _concurrent_rb_tree_node *left;
+    _concurrent_rb_tree_node *right;
+    char color;     // 'R' 或 'B'，红色节点总是左孩子
+};
+
+// 读者无锁的并发红黑树（左倾红黑树）
+// 写者复制从根到修改位置的路径，读者遍历期间不加锁、不写任何共享数据
+// 版本发布、快照与节点回收见 _versioned_tree
+template <typename Ty>
+class concurrent_rb_tree : public _versioned_tree<Ty, _concurrent_rb_tree_node<Ty>>
+{
+    using _base = _versioned_tree<Ty, _concurrent_rb_tree_node<Ty>>;
+    using typename _base::_node;
+
+public:
+    using typename _base::value_type;
+    using typename _base::size_type;
+    using typename _base::const_reference;
+
+    using typename _base::const_iterator;
+    using typename _base::snapshot;
+    using typename _base::reader;
+
+public: // 构造函数
+    concurrent_rb_tree() = default;
+
+    template <typename InputIt>
+    concurrent_rb_tree(InputIt first, InputIt last)
+    {
+        for (; first != last; ++first)
+            insert(*first);
+    }
+
+private:
+    static bool _is_red(const _node *node) noexcept
+    {
+        return node && node->color == 'R';
+    }
+
+    // 左旋，node 必须已被拥有
+    _node *_left_rotate(_node *node)
+    {
+        /*
+           |            |
+           A <-         B
+          / \          / \
+         1   B  -->   A   3
+            / \      / \
+           2   3    1   2
+        */
+        _node *right = this->_own(node->right);
+        node->right = right->left;
+        right->left = node;
+        right->color = node->color;
+        node->color = 'R';
+        return right;
+    }
+
+    // 右旋，node 必须已被拥有
+    _node *_right_rotate(_node *node)
+    {
+        /*
+             |           |
+             A <-        B
+            / \         / \
+           B   3  -->  1   A
+          / \             / \
+         1   2           2   3
+        */
+        _node *left = this->_own(node->left);
+        node->left = left->right;
+        left->right = node;
+        left->color = node->color;
+        node->color = 'R';
+        return left;
+    }
+
+    // 翻转 node 及其两个孩子的颜色，node 必须已被拥有
+    void _flip_colors(_node *node)
+    {
+        node->left = this->_own(node->left);
+        node->right = this->_own(node->right);
+
+        node->color = node->color == 'R' ? 'B' : 'R';
+        node->left->color = node->left->color == 'R' ? 'B' : 'R';
+        node->right->color = node->right->color == 'R' ? 'B' : 'R';
+    }
+
+    // 恢复左倾性质，node 必须已被拥有，返回子树的新根
+    _node *_balance(_node *node)
+    {
+        if (_is_red(node->right) && !_is_red(node->left))
+            node = _left_rotate(node);
+        if (_is_red(node->left) && _is_red(node->left->left))
+            node = _right_rotate(node);
+        if (_is_red(node->left) && _is_red(node->right))
+            _flip_colors(node);
+        return node;
+    }
+
+    // 使 node 的左孩子或其左孩子为红色，以便向左删除
+    _node *_move_red_left(_node *node)
+    {
+        _flip_colors(node);
+        if (_is_red(node->right->left))
+        {
+            node->right = _right_rotate(node->right);
+            node = _left_rotate(node);
+            _flip_colors(node);
+        }
+        return node;
+    }
+
+    // 使 node 的右孩子或其左孩子为红色，以便向右删除
+    _node *_move_red_right(_node *node)
+    {
+        _flip_colors(node);
+        if (_is_red(node->left->left))
+        {
+            node = _right_rotate(node);
+            _flip_colors(node);
+        }
+        return node;
+    }
+
+    _node *_insert(_node *node, const value_type &val, bool &inserted)
+    {
+        if (!node)
+        {
+            inserted = true;
+            return _base::_make_node(val, this->_stamp, nullptr, nullptr, 'R');
+        }
+
+        if (val < node->data)
+        {
+            _node *left = _insert(node->left, val, inserted);
+            if (!inserted)
+                return node;
+
+            node = this->_own(node);
+            node->left = left;
+        }
+        else if (node->data < val)
+        {
+            _node *right = _insert(node->right, val, inserted);
+            if (!inserted)
+                return node;
+
+            node = this->_own(node);
+            node->right = right;
+        }
+        else
+            return node; // 已存在
+
+        return _balance(node);
+    }
+
+    // 删除子树中的最小节点，返回子树的新根
+    _node *_erase_min(_node *node)
+    {
+        if (!node->left)
+        {
+            this->_drop(node);
+            return nullptr;
+        }
+
+        node = this->_own(node);
+        if (!_is_red(node->left) && !_is_red(node->left->left))
+            node = _move_red_left(node);
+
+        node->left = _erase_min(node->left);
+        return _balance(node);
+    }
+
+    // 删除 val，val 必须存在
+    _node *_erase(_node *node, const value_type &val)
+    {
+        node = this->_own(node);
+        if (val < node->data)
+        {
+            if (!_is_red(node->left) && !_is_red(node->left->left))
+                node = _move_red_left(node);
+            node->left = _erase(node->left, val);
+        }
+        else
+        {
+            if (_is_red(node->left))
+                node = _right_rotate(node);
+
+            if (!(node->data < val) && !node->right)
+            {
+                // 没有右孩子的黑色节点也没有左孩子
+                this->_drop(node);
+                return nullptr;
+            }
+
+            if (!_is_red(node->right) && !_is_red(node->right->left))
+                node = _move_red_right(node);
+
+            if (!(node->data < val))
+            {
+                // 以右子树的最小元素代替被删除的元素
+                _node *min = node->right;
+                while (min->left)
+                    min = min->left;
+
+                node->data = min->data;
+                node->right = _erase_min(node->right);
+            }
+            else
+                node->right = _erase(node->right, val);
+        }
+
+        return _balance(node);
+    }
+
+public:
+    // 插入元素，已存在时返回 false
+    bool insert(const value_type &val)
+    {
+        return this->_modify([this, &val](_node *root) {
+            bool inserted = false;
+            root = _insert(root, val, inserted);
+            if (inserted)
+                root->color = 'B';
+            return std::pair<_node *, ptrdiff_t>(root, inserted ? 1 : 0);
+        });
+    }
+
+    // 删除元素，不存在时返回 false
+    bool erase(const value_type &val)
+    {
+        return this->_modify([this, &val](_node *root) {
+            if (!this->_find(root, val))
+                return std::pair<_node *, ptrdiff_t>(root, 0);
+
+            root = this->_own(root);
+            if (!_is_red(root->left) && !_is_red(root->right))
+                root->color = 'R';
+
+            root = _erase(root, val);
+            if (root)
+                root->color = 'B';
+            return std::pair<_node *, ptrdiff_t>(root, -1);
+        });
+    }
+}; // class concurrent_rb_tree<>
+
+} // namespace ds
@@ -0,0 +1,335 @@
+﻿// counted_rb_tree.hpp : 计数红黑树
+//
+
+#pragma once
+
+#include <iterator>
+#include <cassert>
+
+#include "rb_tree.hpp"
+
+namespace ds
+{
+
+template <typename Ty>
+class counted_rb_tree;
+
+template <typename Ty>
+struct _counted_rb_tree_node : _rb_tree_node_base
+{
+    Ty data;
+    size_t count; // 与 data 相等的元素个数，至少为 1
+};
+
+// 迭代器，相等的元素被逐个访问
+template <typename Ty>
+class _counted_rb_tree_const_iterator
+{
+    friend class counted_rb_tree<Ty>;
+
+public:
+    // 双向
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = Ty;
+
+    using difference_type = ptrdiff_t;
+
+    using pointer = const value_type *;
+    using reference = const value_type &;
+
+private:
+    using _node_base = _rb_tree_node_base;
+    using _node = _counted_rb_tree_node<Ty>;
+
+    _counted_rb_tree_const_iterator(_node_base *ptr, size_t index = 0, bool is_end = false)
+        : _ptr(ptr), _index(index), _is_end(is_end) {}
+
+    size_t _count() const noexcept
+    {
+        return static_cast<_node *>(_ptr)->count;
+    }
+
+public:
+    // 解引用
+    const value_type &operator*() const
+    {
+        assert(!_is_end);
+        return static_cast<_node *>(_ptr)->data;
+    }
+
+    const value_type *operator->() const
+    {
+        assert(!_is_end);
+        return &static_cast<_node *>(_ptr)->data;
+    }
+
+    // 自增
+    _counted_rb_tree_const_iterator &operator++()
+    {
+        assert(!_is_end);
+
+        if (_index + 1 < _count())
+            ++_index;
+        else if (_node_base *next = _rb_tree_base::_next(_ptr); next != _rb_tree_base::_null)
+        {
+            _ptr = next;
+            _index = 0;
+        }
+        else
+        {
+            _index = 0;
+            _is_end = true;
+        }
+
+        return *this;
+    }
+
+    _counted_rb_tree_const_iterator operator++(int)
+    {
+        _counted_rb_tree_const_iterator tmp(*this);
+        ++*this;
+        return tmp;
+    }
+
+    // 自减
+    _counted_rb_tree_const_iterator &operator--()
+    {
+        if (_is_end)
+        {
+            _is_end = false;
+            _index = _count() - 1;
+        }
+        else if (_index > 0)
+            --_index;
+        else
+        {
+            _ptr = _rb_tree_base::_prev(_ptr);
+            _index = _count() - 1;
+        }
+
+        assert(_ptr != _rb_tree_base::_null);
+        return *this;
+    }
+
+    _counted_rb_tree_const_iterator operator--(int)
+    {
+        _counted_rb_tree_const_iterator tmp(*this);
+        --*this;
+        return tmp;
+    }
+
+    friend bool operator==(const _counted_rb_tree_const_iterator &left, const _counted_rb_tree_const_iterator &right)
+    {
+        return left._ptr == right._ptr && left._index == right._index && left._is_end == right._is_end;
+    }
+
+    friend bool operator!=(const _counted_rb_tree_const_iterator &left, const _counted_rb_tree_const_iterator &right)
+    {
+        return !(left == right);
+    }
+
+private:
+    _node_base *_ptr;
+    size_t _index;        // 在相等元素中的序号
+    bool _is_end = false;
+}; // class _counted_rb_tree_const_iterator<>
+
+// 计数红黑树
+// 可重复的有序集合，相等的元素共用一个节点并记录个数
+// 重复元素很多时，节点数只与不同元素的个数有关
+template <typename Ty>
+class counted_rb_tree : public _rb_tree_base
+{
+public:
+    using value_type = Ty;
+    using size_type = size_t;
+
+    using pointer = value_type *;
+    using const_pointer = const value_type *;
+    using reference = value_type &;
+    using const_reference = const value_type &;
+
+    using const_iterator = _counted_rb_tree_const_iterator<Ty>;
+
+private:
+    using _node = _counted_rb_tree_node<Ty>;
+
+public: // 构造函数
+    counted_rb_tree() = default;
+
+    template <typename InputIt>
+    counted_rb_tree(InputIt first, InputIt last)
+    {
+        for (; first != last; ++first)
+            insert(*first);
+    }
+
+    counted_rb_tree(const counted_rb_tree &) = delete;
+    counted_rb_tree(counted_rb_tree &&) = delete;
+
+    counted_rb_tree operator=(const counted_rb_tree &) = delete;
+    counted_rb_tree operator=(counted_rb_tree &&) = delete;
+
+private:
+    // 释放内存
+    void _free_node(_node_base *node)
+    {
+        if (node == _null)
+            return;
+        _free_node(node->left);
+        _free_node(node->right);
+
+        delete static_cast<_node *>(node);
+    }
+
+    static _node *_cast(_node_base *node) noexcept
+    {
+        return static_cast<_node *>(node);
+    }
+
+    _node_base *_find_node(const value_type &e) const
+    {
+        _node_base *p = _root;
+        while (p != _null)
+        {
+            if (_cast(p)->data < e)
+                p = p->right;
+            else if (e < _cast(p)->data)
+                p = p->left;
+            else
+                break;
+        }
+        return p;
+    }
+
+    // 删除整个节点
+    void _erase_node(_node_base *node)
+    {
+        _size -= _cast(node)->count;
+        --_node_count;
+
+        _extract_node(node);
+        delete _cast(node);
+    }
+
+public:
+    ~counted_rb_tree()
+    {
+        _free_node(_root);
+    }
+
+    // 插入 n 个元素，返回指向第一个新元素的迭代器
+    const_iterator insert(const value_type &e, size_type n = 1)
+    {
+        assert(n > 0);
+
+        _node_base *parent = _null;
+        bool is_left = false;
+        for (_node_base *p = _root; p != _null; p = is_left ? p->left : p->right)
+        {
+            if (_cast(p)->data < e)
+                is_left = false;
+            else if (e < _cast(p)->data)
+                is_left = true;
+            else
+            {
+                // 已有相等的元素，只增加计数
+                size_t index = _cast(p)->count;
+                _cast(p)->count += n;
+                _size += n;
+                return {p, index};
+            }
+            parent = p;
+        }
+
+        _node *node = new _node{{}, e, n};
+        _link_node(node, parent, is_left);
+        _size += n;
+        ++_node_count;
+        return {node};
+    }
+
+    // 删除一个元素
+    const_iterator erase(const_iterator it)
+    {
+        assert(!it._is_end);
+
+        _node *node = _cast(it._ptr);
+        if (node->count > 1)
+        {
+            --node->count;
+            --_size;
+            return it._index < node->count ? it : std::next(const_iterator(node, node->count - 1));
+        }
+
+        auto next = std::next(it);
+        _erase_node(node);
+        return next._is_end ? end() : next; // 尾后迭代器记录了被删除的节点
+    }
+
+    // 删除所有与 e 相等的元素，返回删除的个数
+    size_type erase(const value_type &e)
+    {
+        _node_base *node = _find_node(e);
+        if (node == _null)
+            return 0;
+
+        size_type n = _cast(node)->count;
+        _erase_node(node);
+        return n;
+    }
+
+    // 与 e 相等的元素个数，O(log n)
+    [[nodiscard]] size_type count(const value_type &e) const
+    {
+        _node_base *node = _find_node(e);
+        return node != _null ? _cast(node)->count : 0;
+    }
+
+    // 指向第一个与 e 相等的元素
+    [[nodiscard]] const_iterator find(const value_type &e)
+    {
+        _node_base *node = _find_node(e);
+        return node != _null ? const_iterator(node) : end();
+    }
+
+    // 元素个数，包括重复的元素
+    [[nodiscard]] size_type size() const noexcept
+    {
+        return _size;
+    }
+
+    [[nodiscard]] bool empty() const noexcept
+    {
+        return _size == 0;
+    }
+
+    // 不同元素的个数，即节点数
+    [[nodiscard]] size_type distinct() const noexcept
+    {
+        return _node_count;
+    }
+
+    // 迭代器
+    [[nodiscard]] const_iterator begin()
+    {
+        if (_root == _null)
+            return {_null, 0, true};
+        return {_min};
+    }
+
+    [[nodiscard]] const_iterator end()
+    {
+        return {_max, 0, true};
+    }
+
+private:
+    size_type _size = 0;
+    size_type _node_count = 0;
+}; // class counted_rb_tree<>
+
+// 推导指引
+template <typename InputIt>
+counted_rb_tree(InputIt, InputIt)->counted_rb_tree<typename std::iterator_traits<InputIt>::value_type>;
+
+} // namespace ds
@@ -0,0 +1,272 @@
+﻿// eytzinger_index.hpp : Eytzinger 布局的只读有序索引
+//
+
+#pragma once
+
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <cassert>
+
+#include "_common.hpp"
+
+namespace ds
+{
+
+template <typename Ty>
+class eytzinger_index;
+
+// 迭代器，按升序访问
+// 位置 k 从 1 开始，k 的孩子为 2k 与 2k + 1，0 表示尾后
+template <typename Ty>
+class _eytzinger_index_const_iterator
+{
+    friend class eytzinger_index<Ty>;
+
+public:
+    // 双向
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = Ty;
+
+    using difference_type = ptrdiff_t;
+
+    using pointer = const value_type *;
+    using reference = const value_type &;
+
+private:
+    _eytzinger_index_const_iterator(const eytzinger_index<Ty> *index, size_t pos) : _index(index), _pos(pos) {}
+
+public:
+    _eytzinger_index_const_iterator() = default;
+
+    // 解引用
+    const value_type &operator*() const
+    {
+        assert(_pos != 0);
+        return _index->_at(_pos);
+    }
+
+    const value_type *operator->() const
+    {
+        return &**this;
+    }
+
+    // 自增
+    _eytzinger_index_const_iterator &operator++()
+    {
+        assert(_pos != 0);
+        _pos = _index->_next(_pos);
+        return *this;
+    }
+
+    _eytzinger_index_const_iterator operator++(int)
+    {
+        _eytzinger_index_const_iterator tmp(*this);
+        ++*this;
+        return tmp;
+    }
+
+    // 自减
+    _eytzinger_index_const_iterator &operator--()
+    {
+        _pos = _pos == 0 ? _index->_last() : _index->_prev(_pos);
+        assert(_pos != 0);
+        return *this;
+    }
+
+    _eytzinger_index_const_iterator operator--(int)
+    {
+        _eytzinger_index_const_iterator tmp(*this);
+        --*this;
+        return tmp;
+    }
+
+    friend bool operator==(const _eytzinger_index_const_iterator &left, const _eytzinger_index_const_iterator &right)
+    {
+        return left._pos == right._pos;
+    }
+
+    friend bool operator!=(const _eytzinger_index_const_iterator &left, const _eytzinger_index_const_iterator &right)
+    {
+        return !(left == right);
+    }
+
+private:
+    const eytzinger_index<Ty> *_index = nullptr;
+    size_t _pos = 0;
+}; // class _eytzinger_index_const_iterator<>
+
+// Eytzinger 布局的只读有序索引
+// 元素按完全二叉树的层序连续存放，查找时没有指针追逐，前几层总在缓存中
+// 向下查找的同时预取若干层之后的缓存行，使访存与比较重叠
+// 建立后不能修改，适合构建后长时间只读的场景，语义与 rb_tree 的查找相同
+template <typename Ty>
+class eytzinger_index
+{
+    friend class _eytzinger_index_const_iterator<Ty>;
+
+public:
+    using value_type = Ty;
+    using size_type = size_t;
+
+    using const_reference = const value_type &;
+    using const_iterator = _eytzinger_index_const_iterator<Ty>;
+
+private:
+    // 位置 k * _prefetch_stride 起的 _prefetch_stride 个位置都是 k 在若干层之后的后代，大致占一条缓存行
+    static constexpr size_t _prefetch_stride = sizeof(Ty) < 64 ? 64 / sizeof(Ty) : 1;
+
+public: // 构造函数
+    eytzinger_index() = default;
+
+    // 由升序区间建立
+    template <typename InputIt>
+    eytzinger_index(InputIt first, InputIt last) : eytzinger_index(std::vector<Ty>(first, last)) {}
+
+    explicit eytzinger_index(std::vector<Ty> sorted)
+    {
+        assert(std::is_sorted(sorted.begin(), sorted.end()) && "eytzinger_index requires a sorted range");
+
+        // 中序遍历隐式的完全二叉树，第 i 个访问到的位置存放第 i 小的元素
+        size_t n = sorted.size();
+        std::vector<size_t> rank(n + 1);
+        size_t i = 0;
+        for (size_t k = _first_pos(n); k != 0; k = _next_pos(k, n))
+            rank[k] = i++;
+
+        _data.reserve(n);
+        for (size_t k = 1; k <= n; ++k)
+            _data.push_back(std::move(sorted[rank[k]]));
+    }
+
+private:
+    const value_type &_at(size_t pos) const noexcept
+    {
+        return _data[pos - 1];
+    }
+
+    // 中序第一个位置
+    static size_t _first_pos(size_t n) noexcept
+    {
+        if (n == 0)
+            return 0;
+
+        size_t k = 1;
+        while (2 * k <= n)
+            k = 2 * k;
+        return k;
+    }
+
+    // 中序后继，不存在时返回 0
+    static size_t _next_pos(size_t k, size_t n) noexcept
+    {
+        if (2 * k + 1 <= n)
+        {
+            for (k = 2 * k + 1; 2 * k <= n; k = 2 * k)
+                ;
+            return k;
+        }
+
+        // 上行越过所有作为右孩子的祖先
+        while (k & 1)
+            k >>= 1;
+        return k >> 1;
+    }
+
+    size_t _next(size_t k) const noexcept
+    {
+        return _next_pos(k, _data.size());
+    }
+
+    // 中序前驱，不存在时返回 0
+    size_t _prev(size_t k) const noexcept
+    {
+        size_t n = _data.size();
+        if (2 * k <= n)
+        {
+            for (k = 2 * k; 2 * k + 1 <= n; k = 2 * k + 1)
+                ;
+            return k;
+        }
+
+        while (k > 1 && !(k & 1))
+            k >>= 1;
+        return k >> 1;
+    }
+
+    // 中序最后一个位置
+    size_t _last() const noexcept
+    {
+        size_t k = _data.empty() ? 0 : 1;
+        while (k != 0 && 2 * k + 1 <= _data.size())
+            k = 2 * k + 1;
+        return k;
+    }
+
+    // 向下查找，less(e) 为真时向右
+    // 最终 k 越过叶子，去掉末尾表示向右的 1 与最后一次向左的 0 即为答案
+    template <typename Less>
+    size_t _descend(Less less) const
+    {
+        size_t n = _data.size(), k = 1;
+        while (k <= n)
+        {
+            _prefetch(_data.data() + std::min(k * _prefetch_stride, n) - 1);
+            k = 2 * k + static_cast<size_t>(less(_data[k - 1]));
+        }
+
+        while (k & 1)
+            k >>= 1;
+        return k >> 1;
+    }
+
+public:
+    [[nodiscard]] size_type size() const noexcept
+    {
+        return _data.size();
+    }
+
+    [[nodiscard]] bool empty() const noexcept
+    {
+        return _data.empty();
+    }
+
+    // 第一个不小于 e 的元素
+    [[nodiscard]] const_iterator lower_bound(const value_type &e) const
+    {
+        return {this, _descend([&e](const value_type &x) { return x < e; })};
+    }
+
+    // 第一个大于 e 的元素
+    [[nodiscard]] const_iterator upper_bound(const value_type &e) const
+    {
+        return {this, _descend([&e](const value_type &x) { return !(e < x); })};
+    }
+
+    [[nodiscard]] const_iterator find(const value_type &e) const
+    {
+        const_iterator it = lower_bound(e);
+        return it != end() && !(e < *it) ? it : end();
+    }
+
+    [[nodiscard]] bool contains(const value_type &e) const
+    {
+        return find(e) != end();
+    }
+
+    // 迭代器
+    [[nodiscard]] const_iterator begin() const
+    {
+        return {this, _first_pos(_data.size())};
+    }
+
+    [[nodiscard]] const_iterator end() const
+    {
+        return {this, 0};
+    }
+
+private:
+    std::vector<Ty> _data; // 层序存放，位置 k 对应 _data[k - 1]
+}; // class eytzinger_index<>
+
+} // namespace ds
@@ -0,0 +1,342 @@
+﻿// interval_tree.hpp : 区间树
+//
+
+#pragma once
+
+#include <cstdint>
+
+#include "avl_tree.hpp"
+
+namespace ds
+{
+
+// 闭区间 [low, high]
+template <typename Ty>
+struct interval
+{
+    Ty low;
+    Ty high;
+};
+
+// 先按左端点、再按右端点排序
+template <typename Ty>
+bool operator<(const interval<Ty> &left, const interval<Ty> &right)
+{
+    return left.low < right.low || (!(right.low < left.low) && left.high < right.high);
+}
+
+template <typename Ty>
+bool operator==(const interval<Ty> &left, const interval<Ty> &right)
+{
+    return !(left < right) && !(right < left);
+}
+
+template <typename Ty>
+bool operator!=(const interval<Ty> &left, const interval<Ty> &right)
+{
+    return !(left == right);
+}
+
+// 节点附加数据
+// 每个节点有一个槽位，持有子树中尚未被祖先持有的区间里右端点最大的一个（优先搜索树）
+// 区间不移动，槽位只保存所在节点的指针；未被任何槽位持有的区间留在自己的节点上
+struct _interval_tree_augment
+{
+    _interval_tree_augment *heap = nullptr; // 槽位中区间所在的节点，子树中的区间都已被祖先持有时为空
+    uint64_t seq : 63;                      // 插入序号，区分相等的区间，与中序一致
+    uint64_t held : 1;                      // 本节点的区间是否被某个槽位持有
+
+    _interval_tree_augment() : seq(0), held(false) {}
+};
+
+// 区间树的类型特征
+// 以区间本身为关键字，允许重复
+template <typename Ty>
+struct _interval_tree_traits
+{
+    using key_type = interval<Ty>;
+    using value_type = interval<Ty>;
+
+    static constexpr bool _multi = true;
+    static constexpr bool _top_down = true;
+    using _augment_type = _interval_tree_augment;
+
+    static const key_type &_kfn(const value_type &val) noexcept
+    {
+        return val;
+    }
+
+    // 以下维护槽位，不变式：
+    // 槽位只持有自身或后代节点的区间，每个区间至多被一个槽位持有，
+    // 节点的槽位持有子树中未被祖先持有的区间里右端点最大的一个
+
+    template <typename Node>
+    static Node *_top(const Node *node) noexcept
+    {
+        return static_cast<Node *>(node->heap);
+    }
+
+    // a 在中序中是否位于 b 之前
+    template <typename Node>
+    static bool _before(const Node *a, const Node *b) noexcept
+    {
+        return a->data < b->data || (!(b->data < a->data) && a->seq < b->seq);
+    }
+
+    template <typename Node>
+    static Node *_root_of(Node *node) noexcept
+    {
+        while (node->parent)
+            node = node->parent;
+        return node;
+    }
+
+    // 把未被持有的区间 q 放入 node 的子树，home 是 q 最终所在的节点，必须在 node 的子树中
+    // 沿 home 的方向下降，在空槽位或右端点更小的槽位处持有 q，被换下的区间继续向自己的节点下降
+    // 到达 home 仍未被持有时留在 home 上，O(子树高度)
+    template <typename Node>
+    static void _sift(Node *node, Node *q, Node *home)
+    {
+        while (true)
+        {
+            Node *top = _top(node);
+            if (!top || top->data.high < q->data.high)
+            {
+                node->heap = q;
+                q->held = true;
+                if (!top)
+                    return;
+
+                top->held = false;
+                q = home = top;
+            }
+
+            if (node == home)
+                return;
+            node = _before(home, node) ? static_cast<Node *>(node->left) : static_cast<Node *>(node->right);
+        }
+    }
+
+    // node 的槽位空出后，从自身未被持有的区间与两个孩子的槽位中选出右端点最大的补上
+    // 来自孩子时孩子的槽位随之空出，继续向下补位，O(子树高度)
+    template <typename Node>
+    static void _refill(Node *node)
+    {
+        while (true)
+        {
+            Node *best = node->held ? nullptr : node, *from = nullptr;
+            for (Node *child : {static_cast<Node *>(node->left), static_cast<Node *>(node->right)})
+            {
+                Node *top = child ? _top(child) : nullptr;
+                if (top && (!best || best->data.high < top->data.high))
+                {
+                    best = top;
+                    from = child;
+                }
+            }
+
+            node->heap = best;
+            if (!best)
+                return;
+            if (!from)
+            {
+                best->held = true;
+                return;
+            }
+            node = from;
+        }
+    }
+
+    // 撤出 node 的区间：空出持有它的槽位并补位，此后视为已被持有，不会再被选中
+    template <typename Node>
+    static void _withdraw(Node *node)
+    {
+        if (!node->held)
+        {
+            node->held = true;
+            return;
+        }
+
+        Node *holder = _root_of(node);
+        while (_top(holder) != node)
+            holder = _before(node, holder) ? static_cast<Node *>(holder->left) : static_cast<Node *>(holder->right);
+        holder->heap = nullptr;
+        _refill(holder);
+    }
+
+    // 新叶子链接后从根放入它的区间
+    template <typename Node>
+    static void _linked(Node *node)
+    {
+        _sift(_root_of(node), node, node);
+    }
+
+    // 旋转后原子树根的槽位交给新根，原子树根重新补位，新根原来持有的区间重新放入所在的一侧
+    template <typename Node>
+    static void _rotated(Node *child, Node *top)
+    {
+        Node *q = _top(top);
+        top->heap = child->heap;
+        _refill(child); // 补位时 q 仍标记为已持有，不会被选中
+        if (!q)
+            return;
+
+        q->held = false;
+        if (q == top)
+            return; // 新根的槽位不小于 q，q 留在自己的节点上
+
+        bool in_child = (top->left == child) == _before(q, top);
+        Node *side = in_child ? child : static_cast<Node *>(top->left == child ? top->right : top->left);
+        _sift(side, q, q);
+    }
+
+    // 摘除节点前撤出它的区间，并清空随之消失的位置上的槽位
+    // 有两个孩子时，中序后继 succ 将占据 node 的位置，消失的是 succ 原来的位置
+    template <typename Node>
+    static void _unlinking(Node *node)
+    {
+        _withdraw(node);
+
+        Node *gone = node;
+        if (node->left && node->right)
+        {
+            Node *succ = static_cast<Node *>(node->right);
+            while (succ->left)
+                succ = static_cast<Node *>(succ->left);
+
+            // succ 的区间从根重新放入，以 node 的位置为终点
+            _withdraw(succ);
+            succ->held = false;
+            _sift(_root_of(node), succ, node);
+            gone = succ;
+        }
+
+        // 消失的位置至多有一个孩子，其槽位中的区间移入该孩子的子树
+        if (Node *q = _top(gone))
+        {
+            gone->heap = nullptr;
+            q->held = false;
+            _sift(static_cast<Node *>(gone->left ? gone->left : gone->right), q, q);
+        }
+
+        // 槽位属于位置而不属于节点，随位置交换
+        if (gone != node)
+        {
+            gone->heap = node->heap;
+            node->heap = nullptr;
+        }
+    }
+};
+
+// 区间树
+// 在 AVL 树的基础上按左端点排序，并按右端点组织成优先搜索树：
+// 每个节点的槽位持有子树中尚未被祖先持有的区间里右端点最大的一个
+// stab 访问的节点或在查找路径上，或报告一个结果，O(log n + k)；
+// query 把重叠的区间分为包含 low 的与左端点落在 (low, high] 中的两部分，同为 O(log n + k)
+// 插入 O(log n)；每次旋转要 O(子树高度) 修补槽位，删除可能旋转 O(log n) 次，最坏 O(log² n)
+template <typename Ty>
+class interval_tree : public _avl_tree<_interval_tree_traits<Ty>>
+{
+    using _base = _avl_tree<_interval_tree_traits<Ty>>;
+    using typename _base::_node;
+
+public:
+    using typename _base::value_type;
+    using typename _base::iterator;
+    using typename _base::const_iterator;
+
+public: // 构造函数
+    interval_tree()
+    {
+    }
+
+    template <typename InputIt>
+    interval_tree(InputIt first, InputIt last)
+    {
+        for (; first != last; ++first)
+            insert(*first);
+    }
+
+public:
+    // 插入区间
+    iterator insert(const value_type &val)
+    {
+        assert(!(val.high < val.low));
+
+        auto [node, parent, is_left] = this->_find_insert_pos(val);
+        assert(!node);
+        _node *new_node = this->_new_node(val);
+        new_node->seq = _seq++;
+        return this->_make_iter(this->_link_node(new_node, parent, is_left));
+    }
+    iterator insert(const Ty &low, const Ty &high)
+    {
+        return insert(value_type{low, high});
+    }
+
+private:
+    template <typename Fn>
+    static void _stab(_node *node, const Ty &point, Fn &fn)
+    {
+        // 子树中未被祖先持有的区间都在 point 之前结束，被祖先持有的已在祖先处检查过
+        if (!node || !node->heap || static_cast<_node *>(node->heap)->data.high < point)
+            return;
+
+        const value_type &top = static_cast<_node *>(node->heap)->data;
+        if (!(point < top.low))
+            fn(top);
+
+        // 未被持有的区间不在任何槽位中，在自己的节点上检查
+        if (!node->held && !(point < node->data.low) && !(node->data.high < point))
+            fn(node->data);
+
+        _stab(node->left, point, fn);
+
+        // 右子树的区间都不早于该节点开始
+        if (!(point < node->data.low))
+            _stab(node->right, point, fn);
+    }
+
+    // 按左端点顺序报告左端点落在 (low, high] 中的区间，只访问两条边界路径与这些区间
+    template <typename Fn>
+    static void _walk(_node *node, const Ty &low, const Ty &high, Fn &fn)
+    {
+        while (node)
+        {
+            if (!(low < node->data.low))
+            {
+                node = node->right;
+                continue;
+            }
+
+            _walk(node->left, low, high, fn);
+            if (high < node->data.low)
+                return;
+
+            fn(node->data);
+            node = node->right;
+        }
+    }
+
+public:
+    // 对每个与 [low, high] 重叠的区间调用 fn，O(log n + k)
+    // 先报告包含 low 的区间，顺序不定，再按左端点顺序报告左端点落在 (low, high] 中的区间
+    template <typename Fn>
+    void query(const Ty &low, const Ty &high, Fn fn) const
+    {
+        _stab(this->_root, low, fn);
+        _walk(this->_root, low, high, fn);
+    }
+
+    // 对每个包含 point 的区间调用 fn，顺序不定，O(log n + k)
+    template <typename Fn>
+    void stab(const Ty &point, Fn fn) const
+    {
+        _stab(this->_root, point, fn);
+    }
+
+private:
+    uint64_t _seq = 0; // 下一个插入序号
+}; // class interval_tree<>
+
+} // namespace ds
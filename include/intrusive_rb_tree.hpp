@@ -0,0 +1,298 @@
+﻿// intrusive_rb_tree.hpp : 侵入式红黑树
+//
+
+#pragma once
+
+#include <iterator>
+#include <cassert>
+#include <type_traits>
+
+#include "rb_tree.hpp"
+
+namespace ds
+{
+
+// 侵入式红黑树的挂钩
+// 元素类型公有继承 rb_tree_hook<Tag> 即可放入对应的树，Tag 用于区分同一对象所在的多棵树
+// 链接只属于所在的树：复制元素时不复制链接，副本不在任何树中
+template <typename Tag = void>
+struct rb_tree_hook : _rb_tree_node_base
+{
+    rb_tree_hook() noexcept : _rb_tree_node_base{0, nullptr, nullptr} {}
+
+    rb_tree_hook(const rb_tree_hook &) noexcept : rb_tree_hook() {}
+
+    rb_tree_hook &operator=(const rb_tree_hook &) noexcept
+    {
+        return *this;
+    }
+};
+
+template <typename Ty, typename Tag>
+class intrusive_rb_tree;
+
+// 迭代器，Ty 带 const 时为只读迭代器
+template <typename Ty, typename Tag>
+class _intrusive_rb_tree_iterator
+{
+    friend class intrusive_rb_tree<std::remove_const_t<Ty>, Tag>;
+    template <typename, typename> friend class _intrusive_rb_tree_iterator;
+
+public:
+    // 双向
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = Ty;
+
+    using difference_type = ptrdiff_t;
+
+    using pointer = value_type *;
+    using reference = value_type &;
+
+private:
+    using _node_base = _rb_tree_node_base;
+
+    _intrusive_rb_tree_iterator(_node_base *ptr, bool is_end = false) : _ptr(ptr), _is_end(is_end) {}
+
+public:
+    // 可变迭代器可以转换为只读迭代器
+    template <typename Ty1, typename = std::enable_if_t<!std::is_const_v<Ty1> && std::is_same_v<const Ty1, Ty>>>
+    _intrusive_rb_tree_iterator(const _intrusive_rb_tree_iterator<Ty1, Tag> &other)
+        : _ptr(other._ptr), _is_end(other._is_end) {}
+
+    // 解引用，不应修改元素中参与比较的部分
+    value_type &operator*() const
+    {
+        assert(!_is_end);
+        return *static_cast<Ty *>(static_cast<rb_tree_hook<Tag> *>(_ptr));
+    }
+
+    value_type *operator->() const
+    {
+        return &**this;
+    }
+
+    // 自增
+    _intrusive_rb_tree_iterator &operator++()
+    {
+        assert(!_is_end);
+
+        if (_node_base *next = _rb_tree_base::_next(_ptr); next != _rb_tree_base::_null)
+            _ptr = next;
+        else
+            _is_end = true;
+
+        return *this;
+    }
+
+    _intrusive_rb_tree_iterator operator++(int)
+    {
+        _intrusive_rb_tree_iterator tmp(*this);
+        ++*this;
+        return tmp;
+    }
+
+    // 自减
+    _intrusive_rb_tree_iterator &operator--()
+    {
+        if (_is_end)
+            _is_end = false;
+        else
+            _ptr = _rb_tree_base::_prev(_ptr);
+
+        assert(_ptr != _rb_tree_base::_null);
+        return *this;
+    }
+
+    _intrusive_rb_tree_iterator operator--(int)
+    {
+        _intrusive_rb_tree_iterator tmp(*this);
+        --*this;
+        return tmp;
+    }
+
+    friend bool operator==(const _intrusive_rb_tree_iterator &left, const _intrusive_rb_tree_iterator &right)
+    {
+        return left._ptr == right._ptr && left._is_end == right._is_end;
+    }
+
+    friend bool operator!=(const _intrusive_rb_tree_iterator &left, const _intrusive_rb_tree_iterator &right)
+    {
+        return !(left == right);
+    }
+
+private:
+    _node_base *_ptr;
+    bool _is_end = false;
+}; // class _intrusive_rb_tree_iterator<>
+
+// 侵入式红黑树
+// 节点就是元素自身的挂钩，插入和删除只改动挂钩中的链接，不分配内存也不复制元素
+// 树不拥有元素：元素的生命期由调用方管理，在树中时不能销毁，树析构时也不会释放元素
+// 旋转与修正与 rb_tree 共用 _rb_tree_base
+template <typename Ty, typename Tag = void>
+class intrusive_rb_tree : public _rb_tree_base
+{
+public:
+    using value_type = Ty;
+    using size_type = size_t;
+
+    using pointer = value_type *;
+    using reference = value_type &;
+    using const_reference = const value_type &;
+
+    using hook_type = rb_tree_hook<Tag>;
+    using iterator = _intrusive_rb_tree_iterator<Ty, Tag>;
+    using const_iterator = _intrusive_rb_tree_iterator<const Ty, Tag>;
+
+public: // 构造函数
+    intrusive_rb_tree() = default;
+
+    template <typename ForwardIt>
+    intrusive_rb_tree(ForwardIt first, ForwardIt last)
+    {
+        for (; first != last; ++first)
+            insert(*first);
+    }
+
+    intrusive_rb_tree(const intrusive_rb_tree &) = delete;
+    intrusive_rb_tree(intrusive_rb_tree &&) = delete;
+
+    intrusive_rb_tree operator=(const intrusive_rb_tree &) = delete;
+    intrusive_rb_tree operator=(intrusive_rb_tree &&) = delete;
+
+private:
+    static value_type &_value(_node_base *node) noexcept
+    {
+        return *static_cast<Ty *>(static_cast<hook_type *>(node));
+    }
+
+    // 只读访问时同样取得节点，由只读迭代器保证不经由它修改元素
+    static _node_base *_hook(const value_type &obj) noexcept
+    {
+        return const_cast<hook_type *>(static_cast<const hook_type *>(&obj));
+    }
+
+    template <typename Key>
+    _node_base *_find(const Key &key) const
+    {
+        _node_base *p = _root;
+        while (p != _null)
+        {
+            if (_value(p) < key)
+                p = p->right;
+            else if (key < _value(p))
+                p = p->left;
+            else
+                return p;
+        }
+        return _null;
+    }
+
+public:
+    // 放入元素，相等的元素排在已有元素之后
+    iterator insert(value_type &obj)
+    {
+        _node_base *parent = _null;
+        bool is_left = false;
+        for (_node_base *p = _root; p != _null; p = is_left ? p->left : p->right)
+        {
+            parent = p;
+            is_left = obj < _value(p);
+        }
+
+        _node_base *node = _hook(obj);
+        _link_node(node, parent, is_left);
+        ++_size;
+        return {node};
+    }
+
+    // 取出元素，只有指向它的迭代器失效
+    iterator erase(iterator it)
+    {
+        assert(!it._is_end);
+
+        auto next = std::next(it);
+        _extract_node(it._ptr);
+        --_size;
+        return next._is_end ? end() : next; // 尾后迭代器记录了被取出的节点
+    }
+
+    void erase(value_type &obj)
+    {
+        _extract_node(_hook(obj));
+        --_size;
+    }
+
+    // 不释放任何元素，只清空树
+    void clear() noexcept
+    {
+        _root = _min = _max = _null;
+        _size = 0;
+    }
+
+    // 指向树中的元素 obj
+    [[nodiscard]] iterator iterator_to(value_type &obj) noexcept
+    {
+        return {_hook(obj)};
+    }
+
+    [[nodiscard]] const_iterator iterator_to(const value_type &obj) const noexcept
+    {
+        return {_hook(obj)};
+    }
+
+    // 查找与 key 相等的元素，key 可以是任何能与元素比较的类型
+    template <typename Key>
+    [[nodiscard]] iterator find(const Key &key)
+    {
+        _node_base *p = _find(key);
+        return p == _null ? end() : iterator(p);
+    }
+
+    template <typename Key>
+    [[nodiscard]] const_iterator find(const Key &key) const
+    {
+        _node_base *p = _find(key);
+        return p == _null ? end() : const_iterator(p);
+    }
+
+    [[nodiscard]] size_type size() const noexcept
+    {
+        return _size;
+    }
+
+    [[nodiscard]] bool empty() const noexcept
+    {
+        return _root == _null;
+    }
+
+    // 迭代器
+    [[nodiscard]] iterator begin()
+    {
+        if (_root == _null)
+            return {_null, true};
+        return {_min};
+    }
+
+    [[nodiscard]] iterator end()
+    {
+        return {_max, true};
+    }
+
+    [[nodiscard]] const_iterator begin() const
+    {
+        if (_root == _null)
+            return {_null, true};
+        return {_min};
+    }
+
+    [[nodiscard]] const_iterator end() const
+    {
+        return {_max, true};
+    }
+
+private:
+    size_type _size = 0;
+}; // class intrusive_rb_tree<>
+
+} // namespace ds
@@ -0,0 +1,243 @@
+﻿// persistent_avl_tree.hpp : 可持久化 AVL 树
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+#include "_versioned_tree.hpp"
+
+namespace ds
+{
+
+// 可持久化 AVL 树的节点
+template <typename Ty>
+struct _persistent_avl_tree_node
+{
+    Ty data;
+    uint64_t stamp; // 创建该节点的修改序号，与当前序号相同时可原地修改
+    _persistent_avl_tree_node *left;
+    _persistent_avl_tree_node *right;
+    int height;     // 以该节点为根的子树高度
+};
+
+// 可持久化 AVL 树
+// 每次修改只复制从根到修改位置的路径，已发布的节点不再修改
+// 读者从不等待写者，但同时存活的快照与读者超过 _epoch_domain::max_readers 个时，新的读者要等待其中之一释放
+// 版本发布、快照与节点回收见 _versioned_tree
+template <typename Ty>
+class persistent_avl_tree : public _versioned_tree<Ty, _persistent_avl_tree_node<Ty>>
+{
+    using _base = _versioned_tree<Ty, _persistent_avl_tree_node<Ty>>;
+    using typename _base::_node;
+
+public:
+    using typename _base::value_type;
+    using typename _base::size_type;
+    using typename _base::const_reference;
+
+    using typename _base::const_iterator;
+    using typename _base::snapshot;
+    using typename _base::reader;
+
+public: // 构造函数
+    persistent_avl_tree() = default;
+
+    template <typename InputIt>
+    persistent_avl_tree(InputIt first, InputIt last)
+    {
+        for (; first != last; ++first)
+            insert(*first);
+    }
+
+private:
+    static int _height(const _node *node) noexcept
+    {
+        return node ? node->height : 0;
+    }
+
+    static void _update_height(_node *node) noexcept
+    {
+        node->height = std::max(_height(node->left), _height(node->right)) + 1;
+    }
+
+    // 创建本次修改的新节点
+    _node *_make_node(const value_type &val)
+    {
+        return _base::_make_node(val, this->_stamp, nullptr, nullptr, 1);
+    }
+
+    // 右旋，node 必须已被拥有
+    _node *_right_rotate(_node *node)
+    {
+        /*
+             |           |
+             A <-        B
+            / \         / \
+           B   3  -->  1   A
+          / \             / \
+         1   2           2   3
+        */
+        _node *left = this->_own(node->left);
+        node->left = left->right;
+        left->right = node;
+        _update_height(node);
+        _update_height(left);
+        return left;
+    }
+
+    // 左旋，node 必须已被拥有
+    _node *_left_rotate(_node *node)
+    {
+        /*
+           |            |
+           A <-         B
+          / \          / \
+         1   B  -->   A   3
+            / \      / \
+           2   3    1   2
+        */
+        _node *right = this->_own(node->right);
+        node->right = right->left;
+        right->left = node;
+        _update_height(node);
+        _update_height(right);
+        return right;
+    }
+
+    // 恢复 node 处的平衡，node 必须已被拥有，返回子树的新根
+    _node *_balance(_node *node)
+    {
+        int bf = _height(node->left) - _height(node->right);
+        if (bf > 1)
+        {
+            if (_height(node->left->left) < _height(node->left->right))
+                node->left = _left_rotate(this->_own(node->left));
+            return _right_rotate(node);
+        }
+        if (bf < -1)
+        {
+            if (_height(node->right->right) < _height(node->right->left))
+                node->right = _right_rotate(this->_own(node->right));
+            return _left_rotate(node);
+        }
+
+        _update_height(node);
+        return node;
+    }
+
+    _node *_insert(_node *node, const value_type &val, bool &inserted)
+    {
+        if (!node)
+        {
+            inserted = true;
+            return _make_node(val);
+        }
+
+        if (val < node->data)
+        {
+            _node *left = _insert(node->left, val, inserted);
+            if (!inserted)
+                return node;
+
+            node = this->_own(node);
+            node->left = left;
+        }
+        else if (node->data < val)
+        {
+            _node *right = _insert(node->right, val, inserted);
+            if (!inserted)
+                return node;
+
+            node = this->_own(node);
+            node->right = right;
+        }
+        else
+            return node; // 已存在
+
+        return _balance(node);
+    }
+
+    // 从子树中摘除最小节点，返回子树的新根
+    _node *_detach_min(_node *node, _node *&min)
+    {
+        if (!node->left)
+        {
+            min = node;
+            return node->right;
+        }
+
+        _node *left = _detach_min(node->left, min);
+        node = this->_own(node);
+        node->left = left;
+        return _balance(node);
+    }
+
+    _node *_erase(_node *node, const value_type &val, bool &erased)
+    {
+        if (!node)
+            return nullptr;
+
+        if (val < node->data)
+        {
+            _node *left = _erase(node->left, val, erased);
+            if (!erased)
+                return node;
+
+            node = this->_own(node);
+            node->left = left;
+        }
+        else if (node->data < val)
+        {
+            _node *right = _erase(node->right, val, erased);
+            if (!erased)
+                return node;
+
+            node = this->_own(node);
+            node->right = right;
+        }
+        else
+        {
+            erased = true;
+            _node *left = node->left, *right = node->right;
+            this->_drop(node);
+
+            if (!left || !right)
+                return left ? left : right;
+
+            // 以右子树的最小节点代替被删除的节点
+            _node *min;
+            right = _detach_min(right, min);
+            node = this->_own(min);
+            node->left = left;
+            node->right = right;
+        }
+
+        return _balance(node);
+    }
+
+public:
+    // 插入元素，已存在时返回 false
+    bool insert(const value_type &val)
+    {
+        return this->_modify([this, &val](_node *root) {
+            bool inserted = false;
+            root = _insert(root, val, inserted);
+            return std::pair<_node *, ptrdiff_t>(root, inserted ? 1 : 0);
+        });
+    }
+
+    // 删除元素，不存在时返回 false
+    bool erase(const value_type &val)
+    {
+        return this->_modify([this, &val](_node *root) {
+            bool erased = false;
+            root = _erase(root, val, erased);
+            return std::pair<_node *, ptrdiff_t>(root, erased ? -1 : 0);
+        });
+    }
+}; // class persistent_avl_tree<>
+
+} // namespace ds
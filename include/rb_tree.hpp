@@ -3,196 +3,154 @@
 
 #pragma once
 
+#include <chrono>
 #include <iterator>
 #include <memory>
+#include <new>
 #include <cassert>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "_common.hpp"
+#include "_snapshot.hpp"
+#include "eytzinger_index.hpp"
 
 namespace ds
 {
 
-template <typename Ty>
-class rb_tree;
-
-// 迭代器
-template <typename Ty>
-class _rb_tree_const_iterator
+// 节点中与元素类型无关的部分
+// 节点至少按指针对齐，父节点指针的最低两位总是 0，用来保存颜色与分配方式
+// 与单独的 char 相比，每个节点省去一个指针宽度的填充
+struct _rb_tree_node_base
 {
-    friend class rb_tree<Ty>;
-
-public:
-    // 双向
-    using iterator_category = std::bidirectional_iterator_tag;
-    using value_type = Ty;
-
-    using difference_type = size_t;
-
-    using pointer = value_type *;
-    using reference = value_type &;
-
-private:
-    using _node = typename rb_tree<Ty>::_node;
+    static constexpr uintptr_t _black = 1;
+    static constexpr uintptr_t _chunked = 2; // 节点位于 rb_tree 的内存块中，而不是单独分配
+    static constexpr uintptr_t _flags = _black | _chunked;
 
-    _rb_tree_const_iterator(_node *ptr, bool is_end = false) : _ptr(ptr), _is_end(is_end) {}
+    uintptr_t parent_color; // 父节点指针 | 分配方式 | 颜色，颜色 0 为红色，1 为黑色
+    _rb_tree_node_base *left;
+    _rb_tree_node_base *right;
 
-public:
-    // 解引用
-    const value_type &operator*()
+    _rb_tree_node_base *parent() const noexcept
     {
-        assert(!_is_end);
-        return _ptr->data;
+        return reinterpret_cast<_rb_tree_node_base *>(parent_color & ~_flags);
     }
 
-    const value_type *operator->()
+    void set_parent(_rb_tree_node_base *parent) noexcept
     {
-        assert(!_is_end);
-        return &_ptr->data;
+        parent_color = reinterpret_cast<uintptr_t>(parent) | (parent_color & _flags);
     }
 
-    // 自增
-    _rb_tree_const_iterator &operator++()
+    // 'R' 或 'B'
+    char color() const noexcept
     {
-        assert(!_is_end && _ptr != _null);
-
-        if (_ptr->right != _null)
-        {
-            for (_ptr = _ptr->right; _ptr->left != _null; _ptr = _ptr->left)
-                ;
-        }
-        else
-        {
-            _node *pt = _ptr;
-            while (pt->parent != _null && pt->parent->right == pt)
-                pt = pt->parent;
-            pt = pt->parent;
-            if (pt != _null)
-                _ptr = pt;
-            else
-                _is_end = true;
-        }
-
-        return *this;
+        return parent_color & _black ? 'B' : 'R';
     }
 
-    _rb_tree_const_iterator operator++(int)
+    void set_color(char color) noexcept
     {
-        _rb_tree_const_iterator tmp(*this);
-        return ++tmp;
+        parent_color = color == 'B' ? parent_color | _black : parent_color & ~_black;
     }
+};
 
-    // 自减
-    _rb_tree_const_iterator &operator--()
-    {
-        if (_is_end)
-        {
-            _is_end = false;
-            assert(_ptr != _null);
-            return *this;
-        }
+static_assert(alignof(_rb_tree_node_base) > 3, "the low two bits of a node pointer must be free");
 
-        if (_ptr->left != _null)
-        {
-            for (_ptr = _ptr->left; _ptr->right != _null; _ptr = _ptr->right)
-                ;
-        }
-        else
-        {
-            while (_ptr->parent != _null && _ptr->parent->left == _ptr)
-                _ptr = _ptr->parent;
-            _ptr = _ptr->parent;
-            assert(_ptr != _null);
-        }
+// 带子树大小的节点，用于顺序统计
+// 同一棵树的节点要么都带子树大小，要么都不带；哨兵带有大小 0，两种树都可以使用
+struct _rb_tree_sized_node_base : _rb_tree_node_base
+{
+    size_t size; // 以该节点为根的子树的节点数
 
-        return *this;
+    static size_t size_of(_rb_tree_node_base *node) noexcept
+    {
+        return static_cast<_rb_tree_sized_node_base *>(node)->size;
     }
 
-    _rb_tree_const_iterator operator--(int)
+    // 由孩子的子树大小重新计算
+    void update_size() noexcept
     {
-        _rb_tree_const_iterator tmp(*this);
-        return --tmp;
+        size = size_of(left) + size_of(right) + 1;
     }
+};
 
-    template <typename Ty1>
-    friend bool operator==(const _rb_tree_const_iterator<Ty1> &, const _rb_tree_const_iterator<Ty1> &);
-
-private:
-    _node *_ptr;
-    bool _is_end = false;
-    static _node *_null;
-}; // class _rb_tree_const_iterator<>
-
-template <typename Ty>
-bool operator==(const _rb_tree_const_iterator<Ty> &left, const _rb_tree_const_iterator<Ty> &right)
-{
-    return left._ptr == right._ptr && left._is_end == right._is_end;
-}
+template <bool Sized>
+using _rb_tree_node_head = std::conditional_t<Sized, _rb_tree_sized_node_base, _rb_tree_node_base>;
 
-template <typename Ty>
-bool operator!=(const _rb_tree_const_iterator<Ty> &left, const _rb_tree_const_iterator<Ty> &right)
+template <typename Ty, bool Sized = false>
+struct _rb_tree_node : _rb_tree_node_head<Sized>
 {
-    return !(left == right);
-}
+    Ty data;
+};
 
-// 红黑树
-template <typename Ty>
-class rb_tree
+// 与元素类型无关的红黑树算法
+// 空孩子与根的父节点均指向哨兵 _null，哨兵由所有树共享，因此从不写入
+// 修改树的算法以 Sized 区分节点是否带子树大小，不带时不为维护大小做任何额外的工作
+class _rb_tree_base
 {
-    friend class _rb_tree_const_iterator<Ty>;
-
 public:
-    using value_type = Ty;
-
-    using pointer = value_type *;
-    using const_pointer = const value_type *;
-    using reference = value_type &;
-    using const_reference = const value_type &;
+    using _node_base = _rb_tree_node_base;
+    using _sized_node_base = _rb_tree_sized_node_base;
 
-    using const_iterator = _rb_tree_const_iterator<Ty>;
+    inline static _sized_node_base _null_node{{_node_base::_black, nullptr, nullptr}, 0};
+    static constexpr _node_base *_null = &_null_node;
 
-private:
-    struct _node
+    // 中序后继，不存在时返回 _null
+    static _node_base *_next(_node_base *node) noexcept
     {
-        value_type data;
-        char color;
-        _node *parent = _null;
-        _node *left = _null;
-        _node *right = _null;
-    };
+        if (node->right != _null)
+        {
+            for (node = node->right; node->left != _null; node = node->left)
+                ;
+            return node;
+        }
 
-public: // 构造函数
-    template <typename InputIt>
-    rb_tree(InputIt first, InputIt last)
-    {
-        for (; first != last; ++first)
-            insert(*first);
+        while (node->parent() != _null && node->parent()->right == node)
+            node = node->parent();
+        return node->parent();
     }
 
-    rb_tree(const rb_tree &) = delete;
-    rb_tree(rb_tree &&) = delete;
+    // 中序前驱，不存在时返回 _null
+    static _node_base *_prev(_node_base *node) noexcept
+    {
+        if (node->left != _null)
+        {
+            for (node = node->left; node->right != _null; node = node->right)
+                ;
+            return node;
+        }
 
-    rb_tree operator=(const rb_tree &) = delete;
-    rb_tree operator=(rb_tree &&) = delete;
+        while (node->parent() != _null && node->parent()->left == node)
+            node = node->parent();
+        return node->parent();
+    }
 
-private:
-    // 释放内存
-    void _free_node(_node *node)
+protected:
+    static _sized_node_base *_sized(_node_base *node) noexcept
     {
-        if (node == _null)
-            return;
-        _free_node(node->left);
-        _free_node(node->right);
+        return static_cast<_sized_node_base *>(node);
+    }
 
-        delete node;
+    static _node_base *_leftmost(_node_base *node) noexcept
+    {
+        if (node != _null)
+            while (node->left != _null)
+                node = node->left;
+        return node;
     }
 
-public:
-    ~rb_tree()
+    static _node_base *_rightmost(_node_base *node) noexcept
     {
-        _free_node(_root);
+        if (node != _null)
+            while (node->right != _null)
+                node = node->right;
+        return node;
     }
 
-private:
     // 左旋
-    void _left_rotate(_node *node)
+    template <bool Sized = false>
+    void _left_rotate(_node_base *node)
     {
         //   |            |
         //   A <-         B
@@ -201,27 +159,35 @@ private:
         //    / \      / \
         //   2   3    1   2
         ////////////////////////
-        _node *right = node->right;
+        _node_base *right = node->right;
         assert(right != _null);
-        if (_node *parent = node->parent; parent == _null)
+        if (_node_base *parent = node->parent(); parent == _null)
         {
             _root = right;
-            right->parent = _null;
+            right->set_parent(_null);
         }
         else
         {
             (parent->left == node ? parent->left : parent->right) = right;
-            right->parent = parent;
+            right->set_parent(parent);
         }
 
         node->right = right->left;
-        right->left->parent = node;
+        if (right->left != _null)
+            right->left->set_parent(node);
         right->left = node;
-        node->parent = right;
+        node->set_parent(right);
+
+        if constexpr (Sized)
+        {
+            _sized(right)->size = _sized(node)->size;
+            _sized(node)->update_size();
+        }
     }
-    
+
     // 右旋
-    void _right_rotate(_node *node)
+    template <bool Sized = false>
+    void _right_rotate(_node_base *node)
     {
         //     |           |
         //     A <-        B
@@ -230,46 +196,57 @@ private:
         //  / \             / \
         // 1   2           2   3
         ///////////////////////////
-        _node *left = node->left;
+        _node_base *left = node->left;
         assert(left != _null);
-        if (_node *parent = node->parent; parent == _null)
+        if (_node_base *parent = node->parent(); parent == _null)
         {
             _root = left;
-            left->parent = _null;
+            left->set_parent(_null);
         }
         else
         {
             (parent->left == node ? parent->left : parent->right) = left;
-            left->parent = parent;
+            left->set_parent(parent);
         }
 
         node->left = left->right;
-        left->right->parent = node;
+        if (left->right != _null)
+            left->right->set_parent(node);
         left->right = node;
-        node->parent = left;
+        node->set_parent(left);
+
+        if constexpr (Sized)
+        {
+            _sized(left)->size = _sized(node)->size;
+            _sized(node)->update_size();
+        }
     }
 
-    void _insert_fix_up(_node *node)
+    // 插入后修正，node 与其父节点均为红色
+    // 返回根是否由红变黑，即整棵树的黑高是否加一
+    template <bool Sized = false>
+    bool _insert_fix_up(_node_base *node)
     {
-        assert(node && node->color == 'R');
+        assert(node && node->color() == 'R');
 
         while (true)
         {
-            _node *parent = node->parent;
+            _node_base *parent = node->parent();
             if (parent == _null)
             {
-                node->color = 'B';
-                return;
+                node->set_color('B');
+                return true;
             }
+            if (parent->color() == 'B')
+                return false;
 
-            _node *grandparent = parent->parent;
-            if (grandparent == _null)
-                return;
-            assert(grandparent->color == 'B');
+            // 父节点为红色，必然不是根
+            _node_base *grandparent = parent->parent();
+            assert(grandparent != _null && grandparent->color() == 'B');
 
             if (grandparent->left == parent)
             {
-                if (grandparent->right->color == 'R')
+                if (grandparent->right->color() == 'R')
                 {
                     //     B            R <- |   B           R <-
                     //    / \          / \   |  / \         / \
@@ -277,42 +254,42 @@ private:
                     //  /            /       |  \           \
                     // R <-         R        |   R <-        R
                     //////////////////////////////////////////////
-                    parent->color = 'B';
-                    grandparent->color = 'R';
-                    grandparent->right->color = 'B';
+                    parent->set_color('B');
+                    grandparent->set_color('R');
+                    grandparent->right->set_color('B');
 
                     node = grandparent;
                 }
                 else
                 {
-                    //   B            B           B
-                    //  / \          / \         / \
-                    // R   B  -->   R   B  -->  R   R
-                    //  \          /                 \
-                    //   R        R <-                B
+                    //     B            B           B
+                    //    / \          / \         / \
+                    //   R   B  -->   R   B  -->  R   R
+                    //    \          /                \
+                    //     R        R <-                B
                     //////////////////////////////////////
                     if (parent->right == node)
                     {
-                        _left_rotate(parent);
+                        _left_rotate<Sized>(parent);
 
                         node = parent;
-                        parent = node->parent;
+                        parent = node->parent();
                     }
 
-                    parent->color = 'B';
-                    grandparent->color = 'R';
-                    _right_rotate(grandparent);
+                    parent->set_color('B');
+                    grandparent->set_color('R');
+                    _right_rotate<Sized>(grandparent);
 
                     break;
                 }
             }
             else
             {
-                if (grandparent->left->color == 'R')
+                if (grandparent->left->color() == 'R')
                 {
-                    parent->color = 'B';
-                    grandparent->color = 'R';
-                    grandparent->left->color = 'B';
+                    parent->set_color('B');
+                    grandparent->set_color('R');
+                    grandparent->left->set_color('B');
 
                     node = grandparent;
                 }
@@ -320,260 +297,1274 @@ private:
                 {
                     if (parent->left == node)
                     {
-                        _right_rotate(parent);
+                        _right_rotate<Sized>(parent);
 
                         node = parent;
-                        parent = node->parent;
+                        parent = node->parent();
                     }
 
-                    parent->color = 'B';
-                    grandparent->color = 'R';
-                    _left_rotate(grandparent);
+                    parent->set_color('B');
+                    grandparent->set_color('R');
+                    _left_rotate<Sized>(grandparent);
 
                     break;
                 }
             }
         }
 
-        _root->color = 'B';
+        _root->set_color('B');
+        return false;
     }
 
-public:
-    // 插入元素
-    void insert(const value_type &e)
+    // 将新节点挂到 parent 的 is_left 一侧并修正，parent 为 _null 时作为根
+    template <bool Sized = false>
+    void _link_node(_node_base *node, _node_base *parent, bool is_left)
     {
-        if (_root == _null)
+        node->set_parent(parent);
+        node->left = node->right = _null;
+        if constexpr (Sized)
+            _sized(node)->size = 1;
+
+        if (parent == _null)
         {
-            _root = new _node{e, 'B'};
+            node->set_color('B');
+            _root = _min = _max = node;
             return;
         }
 
-        _node *p = _root;
-        while (true)
-        {
-            if (p->data < e)
-            {
-                if (p->right != _null)
-                {
-                    p = p->right;
-                }
-                else
-                {
-                    p->right = new _node{e, 'R', p};
-                    if (p->color == 'R')
-                        _insert_fix_up(p->right);
-                    return;
-                }
-            }
-            else
-            {
-                if (p->left != _null)
-                {
-                    p = p->left;
-                }
-                else
-                {
-                    p->left = new _node{e, 'R', p};
-                    if (p->color == 'R')
-                        _insert_fix_up(p->left);
-                    return;
-                }
-            }
-        }
+        node->set_color('R');
+        (is_left ? parent->left : parent->right) = node;
+        if (is_left && parent == _min)
+            _min = node;
+        else if (!is_left && parent == _max)
+            _max = node;
+        if constexpr (Sized)
+            for (_node_base *p = parent; p != _null; p = p->parent())
+                ++_sized(p)->size;
+        if (parent->color() == 'R')
+            _insert_fix_up<Sized>(node);
     }
 
-private:
-    void _erase_fix_up(bool is_left, _node *parent)
+    // 删除后修正，parent 的 is_left 一侧缺少一个黑色节点
+    // 该侧的孩子可能是哨兵，因此由参数给出位置而不经由其 parent 链接
+    template <bool Sized = false>
+    void _erase_fix_up(bool is_left, _node_base *parent)
     {
         while (parent != _null)
         {
+            _node_base *node = is_left ? parent->left : parent->right;
+            if (node->color() == 'R')
+            {
+                //  |
+                // (B)
+                //  |    -->  |
+                //  R <-      B
+                ///////////////////
+                node->set_color('B');
+                return;
+            }
+
             if (is_left)
             {
-                _node *left = parent->left;
-                if (left->color == 'R')
+                _node_base *brother = parent->right;
+                if (brother->color() == 'R')
                 {
-                    //  |
-                    // (B)
-                    //  |    -->  |
-                    //  R <-      B
-                    ///////////////////
-                    left->color = 'B';
-                    return;
+                    // 兄弟为红色：旋转使兄弟变为黑色
+                    brother->set_color('B');
+                    parent->set_color('R');
+                    _left_rotate<Sized>(parent);
+                    brother = parent->right;
                 }
 
-                if (parent->color == 'R')
-                    //     R            B
-                    //    / \          /
-                    //  (B)  B  -->   R
-                    //  /            /
-                    // B <-         B
-                    /////////////////////////
-                    return _left_rotate(parent);
-
-                if (_node *brother = parent->right; brother->color == 'R')
+                if (brother->left->color() == 'B' && brother->right->color() == 'B')
                 {
-                    //     B            B
-                    //    / \          /
-                    //  (B)  R  -->   R
-                    //  /            /
-                    // B <-         B <-
-                    /////////////////////////
-                    _left_rotate(parent);
-
-                    parent->color = 'R';
-                    brother->color = 'B';
+                    // 兄弟的孩子均为黑色：兄弟变红，缺少的黑色上移到 parent
+                    brother->set_color('R');
+                    node = parent;
+                    parent = node->parent();
+                    is_left = parent->left == node;
+                    continue;
                 }
-                else
+
+                if (brother->right->color() == 'B')
                 {
-                    //     B            B <-
-                    //    / \          /
-                    //  (B)  B  -->   R
-                    //  /            /
-                    // B <-         B
-                    ///////////////////////////
-                    _left_rotate(parent);
-
-                    parent = brother->parent;
-                    is_left = (parent->left == brother);
+                    // 兄弟的近侧孩子为红色：转化为远侧孩子为红色
+                    brother->left->set_color('B');
+                    brother->set_color('R');
+                    _right_rotate<Sized>(brother);
+                    brother = parent->right;
                 }
-                continue;
+
+                // 兄弟的远侧孩子为红色：旋转后补上缺少的黑色
+                brother->set_color(parent->color());
+                parent->set_color('B');
+                brother->right->set_color('B');
+                _left_rotate<Sized>(parent);
+                return;
             }
             else
             {
-                _node *right = parent->right;
-                if (right->color == 'R')
+                _node_base *brother = parent->left;
+                if (brother->color() == 'R')
                 {
-                    right->color = 'B';
-                    return;
+                    brother->set_color('B');
+                    parent->set_color('R');
+                    _right_rotate<Sized>(parent);
+                    brother = parent->left;
                 }
 
-                if (parent->color == 'R')
-                    return _right_rotate(parent);
-
-                if (_node *brother = parent->left; brother->color == 'R')
+                if (brother->left->color() == 'B' && brother->right->color() == 'B')
                 {
-                    _right_rotate(parent);
-
-                    parent->color = 'R';
-                    brother->color = 'B';
+                    brother->set_color('R');
+                    node = parent;
+                    parent = node->parent();
+                    is_left = parent->left == node;
+                    continue;
                 }
-                else
-                {
-                    _right_rotate(parent);
 
-                    parent = brother->parent;
-                    is_left = (parent->left == brother);
+                if (brother->left->color() == 'B')
+                {
+                    brother->right->set_color('B');
+                    brother->set_color('R');
+                    _left_rotate<Sized>(brother);
+                    brother = parent->left;
                 }
-                continue;
+
+                brother->set_color(parent->color());
+                parent->set_color('B');
+                brother->left->set_color('B');
+                _right_rotate<Sized>(parent);
+                return;
             }
         }
+
+        // 缺少的黑色上移到了根
+        _root->set_color('B');
     }
 
-    void _erase(const_iterator it)
+    // 摘除至多有一个孩子的节点，不释放内存
+    template <bool Sized = false>
+    void _unlink_node(_node_base *node)
     {
-        _node *parent = it._ptr->parent, *child = it._ptr->left != _null ? it._ptr->left : it._ptr->right;
+        assert(node->left == _null || node->right == _null);
+
+        _node_base *parent = node->parent(), *child = node->left != _null ? node->left : node->right;
+        if constexpr (Sized)
+            for (_node_base *p = parent; p != _null; p = p->parent())
+                --_sized(p)->size;
+
+        if (node == _min)
+            _min = node->right != _null ? _leftmost(node->right) : parent;
+        if (node == _max)
+            _max = node->left != _null ? _rightmost(node->left) : parent;
+        if (child != _null)
+            child->set_parent(parent);
 
         if (parent != _null)
         {
-            if (parent->left == it._ptr)
-            {
-                parent->left = child;
-                child->parent = parent;
-
-                if (it._ptr->color == 'B')
-                    _erase_fix_up(true, parent);
-            }
-            else
-            {
-                parent->right = child;
-                child->parent = parent;
+            bool is_left = parent->left == node;
+            (is_left ? parent->left : parent->right) = child;
 
-                if (it._ptr->color == 'B')
-                    _erase_fix_up(false, parent);
-            }
+            if (node->color() == 'B')
+                _erase_fix_up<Sized>(is_left, parent);
         }
         else
         {
             _root = child;
-            _root->parent = _null;
-            _root->color = 'B';
+            if (_root != _null)
+                _root->set_color('B');
         }
-
-        delete it._ptr;
     }
 
-public:
-    // 删除元素
-    const_iterator erase(const_iterator it)
+    // 与中序后继交换在树中的位置和颜色，node 必须有两个孩子
+    // 只改动链接，两个节点的内容都不移动
+    template <bool Sized = false>
+    void _swap_with_successor(_node_base *node)
     {
-        assert(!it._is_end);
+        assert(node->left != _null && node->right != _null);
 
-        auto next = std::next(it);
-        if (it._ptr->left != _null && it._ptr->right != _null)
+        _node_base *next = _leftmost(node->right);
+        _node_base *parent = node->parent(), *left = node->left, *right = node->right;
+        _node_base *next_parent = next->parent(), *next_right = next->right;
+
+        char color = node->color();
+        node->set_color(next->color());
+        next->set_color(color);
+        if constexpr (Sized)
+            std::swap(_sized(node)->size, _sized(next)->size);
+
+        // node 有两个孩子，不是最小节点；next 可能是最大节点
+        if (_max == next)
+            _max = node;
+
+        // next 取代 node
+        if (parent == _null)
+            _root = next;
+        else
+            (parent->left == node ? parent->left : parent->right) = next;
+        next->set_parent(parent);
+
+        next->left = left;
+        left->set_parent(next);
+
+        if (next_parent == node)
         {
-            it._ptr->data = std::move(next._ptr->data);
-            _erase(next);
-            return it;
+            next->right = node;
+            node->set_parent(next);
+        }
+        else
+        {
+            next->right = right;
+            right->set_parent(next);
+            next_parent->left = node;
+            node->set_parent(next_parent);
         }
 
-        _erase(it);
-        return next;
+        // node 取代 next
+        node->left = _null;
+        node->right = next_right;
+        if (next_right != _null)
+            next_right->set_parent(node);
     }
 
-    [[nodiscard]] const_iterator find(const value_type &e)
+    // 将节点从树中摘除，不释放内存，其余节点不移动
+    template <bool Sized = false>
+    void _extract_node(_node_base *node)
     {
-        _node *p = _root;
-        while (p != _null)
+        if (node->left != _null && node->right != _null)
+            _swap_with_successor<Sized>(node);
+        _unlink_node<Sized>(node);
+    }
+
+    // 以下的分割与合并把 _root 当作工作区，调用方负责最后设置 _root、_min 与 _max
+    // 黑高指从子树的根到叶子的路径上黑色节点的个数，包括根
+
+    static size_t _black_height(_node_base *node) noexcept
+    {
+        size_t bh = 0;
+        for (; node != _null; node = node->left)
+            bh += node->color() == 'B';
+        return bh;
+    }
+
+    // 使子树成为独立的树：断开父节点，红色的根改为黑色
+    static _node_base *_detach(_node_base *node, size_t &bh) noexcept
+    {
+        if (node != _null)
         {
-            if (p->data == e)
-                return {p};
-            else if (p->data < e)
-                p = p->right;
-            else
-                p = p->left;
+            node->set_parent(_null);
+            if (node->color() == 'R')
+            {
+                node->set_color('B');
+                ++bh;
+            }
         }
-        return end();
+        return node;
     }
-    
-    // 迭代器
-    [[nodiscard]] const_iterator begin()
+
+    // 以 mid 连接两棵独立的树，left 中的元素 <= mid <= right 中的元素
+    // 在较高的树的边缘找到黑高相同的子树挂上 mid，再按插入修正，O(|left_bh - right_bh| + 1)
+    template <bool Sized = false>
+    _node_base *_join(_node_base *left, size_t left_bh, _node_base *mid, _node_base *right, size_t right_bh, size_t &bh)
     {
-        if (_root == _null)
-            return {_null, true};
+        bool left_taller = left_bh >= right_bh;
+        _node_base *parent = _null, *y = left_taller ? left : right;
+        size_t h = left_taller ? left_bh : right_bh, target = left_taller ? right_bh : left_bh;
+        while (!(y->color() == 'B' && h == target))
+        {
+            h -= y->color() == 'B';
+            parent = y;
+            y = left_taller ? y->right : y->left;
+        }
 
-        _node *p = _root;
-        while (p->left != _null)
-            p = p->left;
-        return {p};
+        // mid 代替 y，y 成为 mid 的一个孩子
+        _node_base *other = left_taller ? right : left;
+        mid->left = left_taller ? y : other;
+        mid->right = left_taller ? other : y;
+        if (mid->left != _null)
+            mid->left->set_parent(mid);
+        if (mid->right != _null)
+            mid->right->set_parent(mid);
+        if constexpr (Sized)
+            _sized(mid)->update_size();
+
+        if (parent == _null)
+        {
+            mid->set_parent(_null);
+            mid->set_color('B');
+            bh = target + 1;
+            return mid;
+        }
+
+        mid->set_parent(parent);
+        mid->set_color('R');
+        (left_taller ? parent->right : parent->left) = mid;
+        if constexpr (Sized)
+            for (_node_base *p = parent; p != _null; p = p->parent())
+                _sized(p)->size += _sized(other)->size + 1;
+
+        _root = left_taller ? left : right;
+        bh = left_taller ? left_bh : right_bh;
+        if (parent->color() == 'R' && _insert_fix_up<Sized>(mid))
+            ++bh;
+        return _root;
     }
 
-    [[nodiscard]] const_iterator end()
+    // 把 _root 为根的树在 node 处分为两棵独立的树，node 本身不属于任何一棵
+    // 沿 node 到根的路径依次合并左右两侧的子树，总代价 O(log n)
+    template <bool Sized = false>
+    void _split(_node_base *node, _node_base *&left, size_t &left_bh, _node_base *&right, size_t &right_bh)
     {
-        if (_root == _null)
-            return {_null, true};
+        size_t bh = _black_height(node);
+        _node_base *parent = node->parent();
+        bool from_left = parent != _null && parent->left == node;
+
+        left_bh = right_bh = bh - (node->color() == 'B');
+        left = _detach(node->left, left_bh);
+        right = _detach(node->right, right_bh);
+
+        while (parent != _null)
+        {
+            _node_base *p = parent;
+            bool p_from_left = from_left;
+            parent = p->parent();
+            from_left = parent != _null && parent->left == p;
+
+            size_t sibling_bh = bh;
+            bh += p->color() == 'B';
+            if (p_from_left)
+            {
+                _node_base *sibling = _detach(p->right, sibling_bh);
+                right = _join<Sized>(right, right_bh, p, sibling, sibling_bh, right_bh);
+            }
+            else
+            {
+                _node_base *sibling = _detach(p->left, sibling_bh);
+                left = _join<Sized>(sibling, sibling_bh, p, left, left_bh, left_bh);
+            }
+        }
+    }
 
-        _node *p = _root;
-        while (p->right != _null)
-            p = p->right;
-        return {p, true};
+    // 由升序的节点 nodes[first, last) 建立完全平衡的子树，返回子树的根
+    // depth 为子树的根的深度，深度为 red_depth 的节点为红色，其余为黑色
+    template <bool Sized = false>
+    static _node_base *_build(_node_base **nodes, size_t first, size_t last, size_t depth, size_t red_depth)
+    {
+        if (first == last)
+            return _null;
+
+        size_t mid = first + (last - first) / 2;
+        _node_base *node = nodes[mid];
+        node->left = _build<Sized>(nodes, first, mid, depth + 1, red_depth);
+        node->right = _build<Sized>(nodes, mid + 1, last, depth + 1, red_depth);
+        if (node->left != _null)
+            node->left->set_parent(node);
+        if (node->right != _null)
+            node->right->set_parent(node);
+
+        node->set_color(depth == red_depth ? 'R' : 'B');
+        if constexpr (Sized)
+            _sized(node)->update_size();
+        return node;
+    }
+
+    // 以升序的节点重建整棵树，O(n)
+    // 除最深的一层外各层都是满的，最深一层染红即满足红黑性质
+    template <bool Sized = false>
+    void _rebuild(_node_base **nodes, size_t count)
+    {
+        size_t full_levels = 0;
+        while ((size_t(2) << full_levels) - 1 <= count)
+            ++full_levels;
+
+        _root = _build<Sized>(nodes, 0, count, 0, full_levels);
+        if (_root != _null)
+            _root->set_parent(_null);
+        _min = _leftmost(_root);
+        _max = _rightmost(_root);
     }
 
+protected:
+    _node_base *_root = _null;
+    _node_base *_min = _null; // 最小节点，供 begin() 在 O(1) 时间内取得
+    _node_base *_max = _null; // 最大节点
+}; // class _rb_tree_base
+
+// rb_tree 内存块的大小：至少 64 KiB 且能容纳 16 个节点的 2 的幂
+// 内存块按自身大小对齐，节点地址的低位清零即得到所在的块
+constexpr size_t _rb_tree_chunk_size(size_t header_size, size_t node_size) noexcept
+{
+    size_t size = size_t(1) << 16;
+    while ((size - header_size) / node_size < 16)
+        size *= 2;
+    return size;
+}
+
+template <typename Ty, bool Ranked = false>
+class rb_tree;
+
+// 迭代器
+template <typename Ty, bool Ranked = false>
+class _rb_tree_const_iterator
+{
+    friend class rb_tree<Ty, Ranked>;
+
+public:
+    // 双向
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = Ty;
+
+    using difference_type = size_t;
+
+    using pointer = value_type *;
+    using reference = value_type &;
+
 private:
-    _node *_root = _null;
+    using _node_base = _rb_tree_node_base;
+    using _node = _rb_tree_node<Ty, Ranked>;
 
-    static _node _null_node, *_null;
-}; // class rb_tree<>
+    _rb_tree_const_iterator(_node_base *ptr, bool is_end = false) : _ptr(ptr), _is_end(is_end) {}
 
-template <typename Ty>
-typename rb_tree<Ty>::_node rb_tree<Ty>::_null_node = {{}, 'B', nullptr, nullptr, nullptr};
-template <typename Ty>
-typename rb_tree<Ty>::_node *rb_tree<Ty>::_null = &_null_node;
+public:
+    // 解引用
+    const value_type &operator*()
+    {
+        assert(!_is_end);
+        return static_cast<_node *>(_ptr)->data;
+    }
 
-template <typename Ty>
-typename _rb_tree_const_iterator<Ty>::_node *_rb_tree_const_iterator<Ty>::_null = rb_tree<Ty>::_null;
+    const value_type *operator->()
+    {
+        assert(!_is_end);
+        return &static_cast<_node *>(_ptr)->data;
+    }
 
-// 推导指引
-template <typename InputIt>
-rb_tree(InputIt, InputIt)->rb_tree<typename std::iterator_traits<InputIt>::value_type>;
+    // 自增
+    _rb_tree_const_iterator &operator++()
+    {
+        assert(!_is_end);
+
+        if (_node_base *next = _rb_tree_base::_next(_ptr); next != _rb_tree_base::_null)
+            _ptr = next;
+        else
+            _is_end = true;
+
+        return *this;
+    }
+
+    _rb_tree_const_iterator operator++(int)
+    {
+        _rb_tree_const_iterator tmp(*this);
+        ++*this;
+        return tmp;
+    }
+
+    // 自减
+    _rb_tree_const_iterator &operator--()
+    {
+        if (_is_end)
+            _is_end = false;
+        else
+            _ptr = _rb_tree_base::_prev(_ptr);
+
+        assert(_ptr != _rb_tree_base::_null);
+        return *this;
+    }
+
+    _rb_tree_const_iterator operator--(int)
+    {
+        _rb_tree_const_iterator tmp(*this);
+        --*this;
+        return tmp;
+    }
+
+    template <typename Ty1, bool Ranked1>
+    friend bool operator==(const _rb_tree_const_iterator<Ty1, Ranked1> &, const _rb_tree_const_iterator<Ty1, Ranked1> &);
+
+private:
+    _node_base *_ptr;
+    bool _is_end = false;
+}; // class _rb_tree_const_iterator<>
+
+template <typename Ty, bool Ranked>
+bool operator==(const _rb_tree_const_iterator<Ty, Ranked> &left, const _rb_tree_const_iterator<Ty, Ranked> &right)
+{
+    return left._ptr == right._ptr && left._is_end == right._is_end;
+}
+
+template <typename Ty, bool Ranked>
+bool operator!=(const _rb_tree_const_iterator<Ty, Ranked> &left, const _rb_tree_const_iterator<Ty, Ranked> &right)
+{
+    return !(left == right);
+}
+
+// 红黑树
+// Ranked 为真时节点维护子树大小，支持 O(log n) 的 rank、select、index_of 与 distance
+// 代价是每个节点多一个 size_t，插入与删除时沿到根的路径更新大小；默认不维护
+template <typename Ty, bool Ranked>
+class rb_tree : public _rb_tree_base
+{
+    friend class _rb_tree_const_iterator<Ty, Ranked>;
+    template <typename> friend class sharded_rb_tree; // 重新划分时在分片之间移交节点
+
+public:
+    using value_type = Ty;
+
+    using pointer = value_type *;
+    using const_pointer = const value_type *;
+    using reference = value_type &;
+    using const_reference = const value_type &;
+
+    using const_iterator = _rb_tree_const_iterator<Ty, Ranked>;
+
+private:
+    using _node = _rb_tree_node<Ty, Ranked>;
+    using _node_head = _rb_tree_node_head<Ranked>;
+
+    // 删除的区间至少有这么长时才分割
+    static constexpr size_t _bulk_erase_threshold = 32;
+
+    // find_many 中同时进行的查找数
+    static constexpr size_t _find_batch = 16;
+
+    // 紧凑化每搬移这么多个节点检查一次用时
+    static constexpr size_t _compact_batch = 64;
+
+    // compact 与批量建立使用的内存块，块头之后是连续的节点槽位，节点按分配顺序即中序存放
+    // refs 为块中尚未释放的节点数，块仍在填充时另加 1，归零时释放整块
+    // 节点的释放只依赖节点本身，块中的节点可以被取出、移入其他树，由最后释放它的一方归还
+    struct _chunk
+    {
+        size_t refs;
+    };
+
+    static constexpr size_t _chunk_header = (sizeof(_chunk) + alignof(_node) - 1) / alignof(_node) * alignof(_node);
+    static constexpr size_t _chunk_size = _rb_tree_chunk_size(_chunk_header, sizeof(_node));
+    static constexpr size_t _chunk_capacity = (_chunk_size - _chunk_header) / sizeof(_node);
+
+public:
+    // 节点句柄，持有从树中取出的节点
+    class node_type
+    {
+        friend class rb_tree;
+
+        explicit node_type(_node *ptr) noexcept : _ptr(ptr) {}
+
+    public:
+        using value_type = Ty;
+
+        node_type() = default;
+
+        node_type(node_type &&other) noexcept : _ptr(other._ptr)
+        {
+            other._ptr = nullptr;
+        }
+
+        node_type &operator=(node_type &&other) noexcept
+        {
+            if (this != &other)
+            {
+                if (_ptr)
+                    _release(_ptr);
+                _ptr = other._ptr;
+                other._ptr = nullptr;
+            }
+            return *this;
+        }
+
+        ~node_type()
+        {
+            if (_ptr)
+                _release(_ptr);
+        }
+
+        [[nodiscard]] bool empty() const noexcept
+        {
+            return _ptr == nullptr;
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return _ptr != nullptr;
+        }
+
+        [[nodiscard]] value_type &value() const
+        {
+            assert(_ptr);
+            return _ptr->data;
+        }
+
+    private:
+        _node *_ptr = nullptr;
+    };
+
+public: // 构造函数
+    rb_tree() = default;
+
+    template <typename InputIt>
+    rb_tree(InputIt first, InputIt last)
+    {
+        for (; first != last; ++first)
+            insert(*first);
+    }
+
+    // 批量建立：复制元素后以 thread_count 个线程稳定排序，再自底向上 O(n) 建树
+    // 相等的元素保持输入顺序，元素类型须可移动赋值
+    // 节点按中序连续分配在内存块中，与 compact() 之后的布局相同
+    template <typename InputIt>
+    rb_tree(InputIt first, InputIt last, size_t thread_count)
+    {
+        std::vector<Ty> sorted(first, last);
+        _parallel_sort(sorted.begin(), sorted.end(), thread_count);
+        _build_from_sorted(sorted.size(), [&sorted](size_t i) { return std::move(sorted[i]); });
+    }
+
+    // 由 save() 写出的快照建立，O(n)，快照损坏时抛出 std::runtime_error
+    explicit rb_tree(std::istream &in)
+    {
+        std::vector<Ty> sorted = _load_snapshot<Ty>(in);
+        auto at = [&sorted](size_t i) -> const value_type & { return sorted[i]; };
+        _check_snapshot_order<Ty>(sorted.size(), at, false);
+        _build_from_sorted(sorted.size(), at);
+    }
+
+    // 由内存中的快照建立，例如映射到内存的快照文件，元素直接从 data 复制到节点
+    rb_tree(const void *data, size_t size)
+    {
+        _snapshot_view<Ty> view(data, size);
+        auto at = [&view](size_t i) { return view[i]; };
+        _check_snapshot_order<Ty>(view.size(), at, false);
+        _build_from_sorted(view.size(), at);
+    }
+
+    rb_tree(const rb_tree &) = delete;
+    rb_tree(rb_tree &&) = delete;
+
+    rb_tree operator=(const rb_tree &) = delete;
+    rb_tree operator=(rb_tree &&) = delete;
+
+private:
+    // 释放内存，返回释放的节点数
+    size_t _free_node(_node_base *node)
+    {
+        if (node == _null)
+            return 0;
+        size_t count = _free_node(node->left) + _free_node(node->right) + 1;
+
+        _destroy_node(node);
+        return count;
+    }
+
+    // 释放一个已摘除的节点，释放的是进行中的紧凑化的下一个节点时放弃紧凑化
+    void _destroy_node(_node_base *node) noexcept
+    {
+        if (node == _compact_cursor)
+            _cancel_compact();
+        _release(static_cast<_node *>(node));
+    }
+
+    static _chunk *_chunk_of(_node_base *node) noexcept
+    {
+        return reinterpret_cast<_chunk *>(reinterpret_cast<uintptr_t>(node) & ~uintptr_t(_chunk_size - 1));
+    }
+
+    static void _unref_chunk(_chunk *chunk) noexcept
+    {
+        if (--chunk->refs == 0)
+            ::operator delete(static_cast<void *>(chunk), _chunk_size, std::align_val_t(_chunk_size));
+    }
+
+    // 释放节点：单独分配的直接删除，块中的析构后归还给所在的块，O(1)
+    static void _release(_node *node) noexcept
+    {
+        if (!(node->parent_color & _node_base::_chunked))
+        {
+            delete node;
+            return;
+        }
+
+        _chunk *chunk = _chunk_of(node);
+        node->~_node();
+        _unref_chunk(chunk);
+    }
+
+    // 在正在填充的块中以 args 构造节点，块已满时换一块新的
+    template <typename... Args>
+    _node *_emplace_in_chunk(Args &&... args)
+    {
+        if (!_fill || _fill_used == _chunk_capacity)
+        {
+            void *memory = ::operator new(_chunk_size, std::align_val_t(_chunk_size));
+            _close_chunk();
+            _fill = ::new (memory) _chunk{1};
+            _fill_used = 0;
+        }
+
+        void *slot = reinterpret_cast<char *>(_fill) + _chunk_header + _fill_used * sizeof(_node);
+        _node *node = ::new (slot) _node{std::forward<Args>(args)...};
+        node->parent_color |= _node_base::_chunked;
+        ++_fill_used;
+        ++_fill->refs;
+        return node;
+    }
+
+    // 停止填充当前的块，块中剩余的槽位不再使用
+    void _close_chunk() noexcept
+    {
+        if (_fill)
+        {
+            _unref_chunk(_fill);
+            _fill = nullptr;
+        }
+    }
+
+    // 放弃进行中的紧凑化，已搬移的节点留在内存块中
+    void _cancel_compact() noexcept
+    {
+        _compact_cursor = _null;
+        _close_chunk();
+    }
+
+    // 把游标处的节点搬到当前内存块的下一个槽位，游标前进到中序后继
+    // 只改写指向它的链接，颜色与子树大小随节点一起复制
+    void _compact_step()
+    {
+        _node *old = static_cast<_node *>(_compact_cursor);
+        _node *node = _emplace_in_chunk(static_cast<const _node_head &>(*old), std::move(old->data));
+
+        _node_base *parent = node->parent();
+        if (parent == _null)
+            _root = node;
+        else if (parent->left == old)
+            parent->left = node;
+        else
+            parent->right = node;
+
+        if (node->left != _null)
+            node->left->set_parent(node);
+        if (node->right != _null)
+            node->right->set_parent(node);
+
+        if (_min == old)
+            _min = node;
+        if (_max == old)
+            _max = node;
+
+        _compact_cursor = _next(node);
+        _release(old);
+    }
+
+    // 以升序的元素 value_at(0), ..., value_at(n - 1) 建立整棵树，树必须为空
+    template <typename Fn>
+    void _build_from_sorted(size_t n, Fn value_at)
+    {
+        std::vector<_node_base *> nodes;
+        nodes.reserve(n);
+        try
+        {
+            for (size_t i = 0; i < n; ++i)
+                nodes.push_back(_emplace_in_chunk(_node_head{}, value_at(i)));
+        }
+        catch (...)
+        {
+            for (_node_base *node : nodes)
+                _release(static_cast<_node *>(node));
+            _close_chunk();
+            throw;
+        }
+
+        _close_chunk();
+        _rebuild(nodes.data(), n);
+    }
+
+    // 以升序的节点重建整棵树，同时更新元素个数
+    void _rebuild(_node_base **nodes, size_t count)
+    {
+        _rb_tree_base::_rebuild<Ranked>(nodes, count);
+        _size = count;
+    }
+
+    static value_type &_data(_node_base *node) noexcept
+    {
+        return static_cast<_node *>(node)->data;
+    }
+
+    // 从 p 开始向下查找 node 的位置并挂入，node 的元素须属于以 p 为根的子树的范围
+    _node_base *_insert_from(_node_base *p, _node_base *node)
+    {
+        const value_type &e = _data(node);
+
+        _node_base *parent = _null;
+        bool is_left = false;
+        for (; p != _null; p = is_left ? p->left : p->right)
+        {
+            parent = p;
+            is_left = !(_data(p) < e);
+        }
+
+        _link_node<Ranked>(node, parent, is_left);
+        ++_size;
+        return node;
+    }
+
+    // 手指查找：从上一个插入的节点 finger 上行到范围包含 e 的祖先，e 不小于 finger 的元素
+    // 修正只做旋转和变色，finger 在插入之间始终留在树中
+    _node_base *_climb_from(_node_base *finger, const value_type &e) const
+    {
+        if (finger == _null)
+            return _root;
+
+        assert(!(e < _data(finger)) && "elements must be inserted in ascending order");
+
+        _node_base *p = finger;
+        while (p->parent() != _null && (p->parent()->right == p || _data(p->parent()) < e))
+            p = p->parent();
+        return p;
+    }
+
+public:
+    ~rb_tree()
+    {
+        _free_node(_root);
+        _close_chunk();
+    }
+
+    // 插入元素
+    const_iterator insert(const value_type &e)
+    {
+        return {_insert_from(_root, new _node{{}, e})};
+    }
+
+    const_iterator insert(value_type &&e)
+    {
+        return {_insert_from(_root, new _node{{}, std::move(e)})};
+    }
+
+    // 原地构造元素并插入
+    template <typename... Args>
+    const_iterator emplace(Args &&... args)
+    {
+        return {_insert_from(_root, new _node{{}, value_type(std::forward<Args>(args)...)})};
+    }
+
+    // 插入节点句柄持有的节点，不分配内存
+    const_iterator insert(node_type &&nh)
+    {
+        if (nh.empty())
+            return end();
+
+        _node *node = nh._ptr;
+        nh._ptr = nullptr;
+        return {_insert_from(_root, node)};
+    }
+
+    // 插入升序区间 [first, last)
+    // 每个元素从上一个新节点（手指）出发，先上行到范围包含它的祖先再向下查找
+    // 插入 k 个元素的总代价约为 O(k log(n / k))，而不是 O(k log n)
+    template <typename InputIt>
+    void insert_sorted(InputIt first, InputIt last)
+    {
+        _node_base *finger = _null;
+        for (; first != last; ++first)
+        {
+            _node_base *node = new _node{{}, *first};
+            finger = _insert_from(_climb_from(finger, _data(node)), node);
+        }
+    }
+
+    // 取出迭代器指向的节点，其余元素的迭代器仍然有效
+    // 不分配内存也不移动元素，内存块中的节点同样原样交给节点句柄
+    node_type extract(const_iterator it)
+    {
+        assert(!it._is_end);
+
+        _node *node = static_cast<_node *>(it._ptr);
+        _extract_node<Ranked>(node);
+        --_size;
+        if (_compact_cursor == node)
+            _cancel_compact();
+        return node_type(node);
+    }
+
+    // 将 other 的所有节点移入本树，不分配内存也不移动元素
+    // other 的节点按升序取出，以手指查找插入
+    void merge(rb_tree &other)
+    {
+        if (&other == this)
+            return;
+
+        other._cancel_compact();
+
+        _node_base *finger = _null;
+        for (_node_base *node = _leftmost(other._root); node != _null;)
+        {
+            _node_base *next = _next(node);
+            other._unlink_node<Ranked>(node); // 最小节点没有左孩子
+            --other._size;
+            finger = _insert_from(_climb_from(finger, _data(node)), node);
+            node = next;
+        }
+    }
+
+    void merge(rb_tree &&other)
+    {
+        merge(other);
+    }
+
+    // 删除元素
+    // 有两个孩子时与后继交换位置而不是移动元素，只有指向被删除元素的迭代器失效
+    const_iterator erase(const_iterator it)
+    {
+        assert(!it._is_end);
+
+        auto next = std::next(it);
+        _extract_node<Ranked>(it._ptr);
+        _destroy_node(it._ptr);
+        --_size;
+        return next._is_end ? end() : next; // 尾后迭代器记录了被删除的节点
+    }
+
+    // 删除 [first, last)，返回 last
+    // 区间较长时在两端分割，中间的子树整体释放，再以 last 连接两侧，O(k + log n)
+    // 区间的长度只数到 _bulk_erase_threshold 为止，不需要子树大小
+    const_iterator erase(const_iterator first, const_iterator last)
+    {
+        size_t count = 0;
+        for (auto it = first; it != last && count < _bulk_erase_threshold; ++it)
+            ++count;
+        if (count < _bulk_erase_threshold)
+        {
+            for (; count > 0; --count)
+                first = erase(first);
+            return first;
+        }
+
+        _node_base *first_node = first._ptr, *last_node = last._is_end ? _null : last._ptr;
+        _node_base *left, *right;
+        size_t left_bh, right_bh;
+
+        _min = _max = _null;
+        _split<Ranked>(first_node, left, left_bh, right, right_bh);
+        _destroy_node(first_node);
+        --_size;
+
+        if (last_node == _null)
+        {
+            _size -= _free_node(right);
+            _root = left;
+        }
+        else
+        {
+            _node_base *middle, *rest;
+            size_t middle_bh, rest_bh, bh;
+
+            _split<Ranked>(last_node, middle, middle_bh, rest, rest_bh);
+            _size -= _free_node(middle);
+            _root = _join<Ranked>(left, left_bh, last_node, rest, rest_bh, bh);
+        }
+
+        _min = _leftmost(_root);
+        _max = _rightmost(_root);
+        return last_node == _null ? end() : const_iterator(last_node);
+    }
+
+    // 删除所有满足 pred 的元素，返回删除的个数
+    // 删除的元素较多时以剩余的节点重建整棵树，O(n)，不逐个修正
+    template <typename Pred>
+    size_t erase_if(Pred pred)
+    {
+        std::vector<_node_base *> kept, removed;
+        kept.reserve(size());
+        for (_node_base *p = _min; p != _null; p = _next(p))
+            (pred(static_cast<const value_type &>(_data(p))) ? removed : kept).push_back(p);
+
+        if (removed.size() * 16 < kept.size())
+        {
+            for (_node_base *node : removed)
+            {
+                _extract_node<Ranked>(node);
+                _destroy_node(node);
+            }
+            _size -= removed.size();
+        }
+        else
+        {
+            for (_node_base *node : removed)
+                _destroy_node(node);
+            _rebuild(kept.data(), kept.size());
+        }
+
+        return removed.size();
+    }
+
+    [[nodiscard]] const_iterator find(const value_type &e)
+    {
+        _node_base *p = _root;
+        while (p != _null)
+        {
+            if (_data(p) == e)
+                return {p};
+            else if (_data(p) < e)
+                p = p->right;
+            else
+                p = p->left;
+        }
+        return end();
+    }
+
+    // 第一个不小于 e 的元素，不存在时返回 end()
+    [[nodiscard]] const_iterator lower_bound(const value_type &e)
+    {
+        _node_base *result = _null;
+        for (_node_base *p = _root; p != _null;)
+        {
+            if (_data(p) < e)
+                p = p->right;
+            else
+            {
+                result = p;
+                p = p->left;
+            }
+        }
+        return result == _null ? end() : const_iterator(result);
+    }
+
+    // 依次查找 [first, last) 中的每个元素，把结果（不存在时为 end()）按顺序写入 out
+    // 每组 _find_batch 个查找轮流下降一层并预取各自的下一个节点，多个缓存缺失的等待互相重叠
+    // 树远大于缓存时，吞吐量高于逐个调用 find
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt find_many(ForwardIt first, ForwardIt last, OutputIt out)
+    {
+        const value_type *keys[_find_batch];
+        _node_base *nodes[_find_batch];
+        while (first != last)
+        {
+            size_t n = 0;
+            for (; n < _find_batch && first != last; ++n, ++first)
+            {
+                keys[n] = std::addressof(*first);
+                nodes[n] = _root;
+            }
+
+            for (bool active = true; active;)
+            {
+                active = false;
+                for (size_t i = 0; i < n; ++i)
+                {
+                    _node_base *p = nodes[i];
+                    if (p == _null || _data(p) == *keys[i])
+                        continue;
+
+                    p = _data(p) < *keys[i] ? p->right : p->left;
+                    _prefetch(p);
+                    nodes[i] = p;
+                    active = true;
+                }
+            }
+
+            for (size_t i = 0; i < n; ++i)
+                *out++ = nodes[i] == _null ? end() : const_iterator(nodes[i]);
+        }
+        return out;
+    }
+
+    // 元素个数
+    [[nodiscard]] size_t size() const noexcept
+    {
+        return _size;
+    }
+
+    [[nodiscard]] bool empty() const noexcept
+    {
+        return _root == _null;
+    }
+
+    // 以下顺序统计要求 Ranked 为真
+
+    // 小于 e 的元素个数，O(log n)
+    [[nodiscard]] size_t rank(const value_type &e) const
+    {
+        static_assert(Ranked, "rank requires rb_tree<Ty, true>");
+
+        size_t r = 0;
+        for (_node_base *p = _root; p != _null;)
+        {
+            if (_data(p) < e)
+            {
+                r += _sized(p->left)->size + 1;
+                p = p->right;
+            }
+            else
+                p = p->left;
+        }
+        return r;
+    }
+
+    // 第 k 小的元素（从 0 开始），k 不小于 size() 时返回 end()，O(log n)
+    // 例如第 p 百分位数为 select(p * (size() - 1) / 100)
+    [[nodiscard]] const_iterator select(size_t k)
+    {
+        static_assert(Ranked, "select requires rb_tree<Ty, true>");
+
+        if (k >= size())
+            return end();
+
+        _node_base *p = _root;
+        while (k != _sized(p->left)->size)
+        {
+            if (k < _sized(p->left)->size)
+                p = p->left;
+            else
+            {
+                k -= _sized(p->left)->size + 1;
+                p = p->right;
+            }
+        }
+        return {p};
+    }
+
+    // 迭代器的序号，end() 的序号为 size()，O(log n)
+    [[nodiscard]] size_t index_of(const_iterator it) const
+    {
+        static_assert(Ranked, "index_of requires rb_tree<Ty, true>");
+
+        if (it._is_end)
+            return size();
+
+        size_t r = _sized(it._ptr->left)->size;
+        for (_node_base *p = it._ptr; p->parent() != _null; p = p->parent())
+        {
+            if (p->parent()->right == p)
+                r += _sized(p->parent()->left)->size + 1;
+        }
+        return r;
+    }
+
+    // 迭代器之间的距离，O(log n)
+    [[nodiscard]] ptrdiff_t distance(const_iterator first, const_iterator last) const
+    {
+        return static_cast<ptrdiff_t>(index_of(last)) - static_cast<ptrdiff_t>(index_of(first));
+    }
+
+    // 迭代器
+    [[nodiscard]] const_iterator begin()
+    {
+        if (_root == _null)
+            return {_null, true};
+        return {_min};
+    }
+
+    [[nodiscard]] const_iterator end()
+    {
+        return {_max, true};
+    }
+
+    // 把当前的元素复制为只读的连续索引，供此后只读的阶段查找
+    // 索引与树互相独立，查找与迭代的语义与树相同
+    [[nodiscard]] eytzinger_index<Ty> freeze() const
+    {
+        std::vector<Ty> sorted;
+        sorted.reserve(size());
+        for (_node_base *p = _min; p != _null; p = _next(p))
+            sorted.push_back(_data(p));
+        return eytzinger_index<Ty>(std::move(sorted));
+    }
+
+    // 按升序把所有元素写成带校验和的二进制快照，元素类型须可平凡复制
+    // 快照可由 rb_tree(std::istream &) 或 rb_tree(const void *, size_t) 以 O(n) 读回
+    void save(std::ostream &out) const
+    {
+        _node_base *p = _min;
+        _save_snapshot<Ty>(out, size(), [&p]() -> const value_type & {
+            const value_type &e = _data(p);
+            p = _next(p);
+            return e;
+        });
+    }
+
+    // 最小、最大元素，O(1)，树不能为空
+    [[nodiscard]] const_reference min() const
+    {
+        assert(_root != _null);
+        return _data(_min);
+    }
+
+    [[nodiscard]] const_reference max() const
+    {
+        assert(_root != _null);
+        return _data(_max);
+    }
+
+    // 取出最小、最大元素，树不能为空
+    // 最值节点至多有一个孩子，摘除时不需要与后继交换，新的最值是它的孩子或父节点
+    // 删除后的变色与旋转均摊 O(1)，不维护子树大小时整个操作均摊 O(1)
+    // Ranked 为真时还要更新到根的路径上的子树大小，为 O(log n)
+    value_type pop_min()
+    {
+        assert(_root != _null);
+        return _pop(_min);
+    }
+
+    value_type pop_max()
+    {
+        assert(_root != _null);
+        return _pop(_max);
+    }
+
+private:
+    value_type _pop(_node_base *node)
+    {
+        _unlink_node<Ranked>(node);
+        --_size;
+        if (_compact_cursor == node)
+            _cancel_compact();
+
+        // 摘除的节点交给句柄，移出元素时抛出异常也会被释放
+        node_type nh(static_cast<_node *>(node));
+        return std::move(nh.value());
+    }
+
+public:
+    // 紧凑化：把所有节点按中序重新分配到连续的内存块中，恢复遍历与查找的局部性
+    // 不旋转也不变色，树的形状与元素都不变；元素被移动，所有迭代器失效
+    // 每搬移一批节点检查一次用时，超过 budget 时返回 false，再次调用从中断处继续，完成时返回 true
+    // 两次调用之间可以修改树，插入到已搬移部分的节点留在原处，直到下一轮紧凑化
+    bool compact(std::chrono::nanoseconds budget = std::chrono::nanoseconds::max())
+    {
+        if (_compact_cursor == _null)
+        {
+            if (_root == _null)
+                return true;
+
+            _compact_cursor = _min;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t moved = 1; _compact_cursor != _null; ++moved)
+        {
+            _compact_step();
+
+            if (moved % _compact_batch == 0 && _compact_cursor != _null &&
+                std::chrono::steady_clock::now() - start >= budget)
+                return false;
+        }
+
+        _close_chunk();
+        return true;
+    }
+
+private:
+    size_t _size = 0;                    // 元素个数
+    _chunk *_fill = nullptr;             // 正在填充的内存块
+    size_t _fill_used = 0;               // 正在填充的块中已分配出的槽位数
+    _node_base *_compact_cursor = _null; // 下一个要搬移的节点，没有进行中的紧凑化时为 _null
+}; // class rb_tree<>
+
+// 推导指引
+template <typename InputIt>
+rb_tree(InputIt, InputIt)->rb_tree<typename std::iterator_traits<InputIt>::value_type>;
+
+template <typename InputIt>
+rb_tree(InputIt, InputIt, size_t)->rb_tree<typename std::iterator_traits<InputIt>::value_type>;
 
 } // namespace ds
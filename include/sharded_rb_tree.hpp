@@ -0,0 +1,278 @@
+﻿// sharded_rb_tree.hpp : 按键区间分片的并发红黑树
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+#include "_epoch.hpp"
+#include "rb_tree.hpp"
+
+namespace ds
+{
+
+// 按键区间分片的并发红黑树
+// 键空间被划分为若干个相邻的区间，每个区间是一棵独立的 rb_tree，各有一把读写锁
+// 写者只锁住目标分片，不同分片上的写入完全并行，不经过任何全局的锁或计数器
+// 划分随数据增长和倾斜自动调整：某个分片明显大于平均值时，以当前元素的分位数重新划分
+// 划分本身发布后不再修改，写者不加锁读取，通过纪元回收推迟释放旧的划分
+// 可重复的有序集合，语义与 rb_tree 相同
+template <typename Ty>
+class sharded_rb_tree
+{
+public:
+    using value_type = Ty;
+    using size_type = size_t;
+
+    using const_reference = const value_type &;
+
+    static constexpr size_t default_shard_count = 16;
+
+private:
+    using _node_base = _rb_tree_node_base;
+
+    // 分片至少有这么多元素时才会因倾斜而重新划分
+    static constexpr size_t _min_repartition_size = 1024;
+
+    // 每个分片独占缓存行，相邻分片的锁与树的元数据之间没有伪共享
+    struct alignas(64) _shard
+    {
+        std::shared_mutex mutex;
+        rb_tree<Ty> tree;
+    };
+
+    // 键区间的划分，发布后不再修改
+    // 分片 i 存放 [bounds[i - 1], bounds[i]) 中的元素，bounds 为空时所有元素都在分片 0
+    struct _layout
+    {
+        std::vector<Ty> bounds;
+        size_t target; // 划分时每个分片的平均元素个数
+    };
+
+public: // 构造函数
+    explicit sharded_rb_tree(size_t shard_count = default_shard_count)
+        : _shards(new _shard[shard_count]), _shard_count(shard_count), _current(new _layout{{}, 0})
+    {
+        assert(shard_count > 0);
+    }
+
+    template <typename InputIt>
+    sharded_rb_tree(InputIt first, InputIt last, size_t shard_count = default_shard_count)
+        : sharded_rb_tree(shard_count)
+    {
+        for (; first != last; ++first)
+            insert(*first);
+    }
+
+    sharded_rb_tree(const sharded_rb_tree &) = delete;
+    sharded_rb_tree(sharded_rb_tree &&) = delete;
+    sharded_rb_tree &operator=(const sharded_rb_tree &) = delete;
+    sharded_rb_tree &operator=(sharded_rb_tree &&) = delete;
+
+    // 调用时不应再有其他线程访问
+    ~sharded_rb_tree()
+    {
+        delete _current.load();
+    }
+
+private:
+    static void _delete_layout(void *ptr)
+    {
+        delete static_cast<_layout *>(ptr);
+    }
+
+    static size_t _shard_of(const _layout *layout, const value_type &e)
+    {
+        return static_cast<size_t>(std::upper_bound(layout->bounds.begin(), layout->bounds.end(), e) -
+                                   layout->bounds.begin());
+    }
+
+    // 锁住 e 所在的分片后调用 f(tree, layout) 并返回其结果
+    // 持有分片锁时划分不会改变，若加锁前划分已被替换则以新的划分重试
+    template <typename Lock, typename Fn>
+    auto _with_shard(const value_type &e, Fn f)
+    {
+        _epoch_domain::guard guard = _epoch.pin();
+        while (true)
+        {
+            const _layout *layout = _current.load();
+            _shard &shard = _shards[_shard_of(layout, e)];
+
+            Lock lock(shard.mutex);
+            if (_current.load() == layout)
+                return f(shard.tree, layout);
+        }
+    }
+
+    static bool _is_skewed(const rb_tree<Ty> &tree, const _layout *layout) noexcept
+    {
+        return tree.size() >= _min_repartition_size && tree.size() > 2 * layout->target;
+    }
+
+    // 写入的分片倾斜时重新划分，其他线程正在重新划分或扫描时跳过
+    // layout 只用来判断划分是否已被别的线程替换，不会被解引用
+    void _repartition_if_changed_from(const _layout *layout)
+    {
+        std::unique_lock<std::shared_mutex> lock(_repartition_mutex, std::try_to_lock);
+        if (lock.owns_lock() && _current.load() == layout)
+            _repartition();
+    }
+
+    // 以所有元素的分位数重新划分，须持有 _repartition_mutex
+    // 锁住全部分片后按序收集节点，逐个分片以 O(n) 重建，不分配节点也不移动元素
+    void _repartition()
+    {
+        std::vector<std::unique_lock<std::shared_mutex>> locks;
+        locks.reserve(_shard_count);
+        for (size_t i = 0; i < _shard_count; ++i)
+            locks.emplace_back(_shards[i].mutex);
+
+        std::vector<_node_base *> nodes;
+        for (size_t i = 0; i < _shard_count; ++i)
+        {
+            rb_tree<Ty> &tree = _shards[i].tree;
+            for (_node_base *p = tree._min; p != _rb_tree_base::_null; p = _rb_tree_base::_next(p))
+                nodes.push_back(p);
+            tree._root = tree._min = tree._max = _rb_tree_base::_null;
+            tree._size = 0;
+        }
+
+        // 第 i 个分片大致从第 i * n / k 个元素开始，前移到与边界相等的第一个元素，相等的元素不跨分片
+        size_t n = nodes.size();
+        auto *layout = new _layout{{}, n / _shard_count};
+        std::vector<size_t> starts{0};
+        for (size_t i = 1; i < _shard_count && n > 0; ++i)
+        {
+            size_t start = i * n / _shard_count;
+            const value_type &bound = rb_tree<Ty>::_data(nodes[start]);
+            while (start > starts.back() && !(rb_tree<Ty>::_data(nodes[start - 1]) < bound))
+                --start;
+
+            starts.push_back(start);
+            layout->bounds.push_back(bound);
+        }
+        starts.push_back(n);
+
+        for (size_t i = 0; i + 1 < starts.size(); ++i)
+            _shards[i].tree._rebuild(nodes.data() + starts[i], starts[i + 1] - starts[i]);
+
+        _layout *old = _current.exchange(layout);
+        locks.clear();
+
+        _epoch.retire(old, _delete_layout);
+        _epoch.reclaim();
+    }
+
+public:
+    // 插入元素
+    void insert(const value_type &e)
+    {
+        const _layout *seen = nullptr;
+        bool skewed = _with_shard<std::unique_lock<std::shared_mutex>>(
+            e, [&e, &seen](rb_tree<Ty> &tree, const _layout *layout) {
+                tree.insert(e);
+                seen = layout;
+                return _is_skewed(tree, layout);
+            });
+
+        if (skewed)
+            _repartition_if_changed_from(seen);
+    }
+
+    // 删除一个与 e 相等的元素，不存在时返回 false
+    bool erase(const value_type &e)
+    {
+        return _with_shard<std::unique_lock<std::shared_mutex>>(
+            e,
+            [&e](rb_tree<Ty> &tree, const _layout *) {
+                auto it = tree.find(e);
+                if (it == tree.end())
+                    return false;
+                tree.erase(it);
+                return true;
+            });
+    }
+
+    // 查找只加读锁，同一分片上的读者互不阻塞
+    [[nodiscard]] bool contains(const value_type &e)
+    {
+        return _with_shard<std::shared_lock<std::shared_mutex>>(
+            e, [&e](rb_tree<Ty> &tree, const _layout *) { return tree.find(e) != tree.end(); });
+    }
+
+    // 元素个数，并发修改时只是某一时刻附近的近似值
+    [[nodiscard]] size_type size()
+    {
+        size_type n = 0;
+        for (size_t i = 0; i < _shard_count; ++i)
+        {
+            std::shared_lock<std::shared_mutex> lock(_shards[i].mutex);
+            n += _shards[i].tree.size();
+        }
+        return n;
+    }
+
+    [[nodiscard]] bool empty()
+    {
+        return size() == 0;
+    }
+
+    [[nodiscard]] size_t shard_count() const noexcept
+    {
+        return _shard_count;
+    }
+
+    // 按升序对 [first, last) 中的每个元素调用 f
+    // 扫描期间划分不变，各分片依次加读锁，每个分片内看到的是一致的状态
+    // f 在持有分片锁时调用，不能再访问本树
+    template <typename Fn>
+    void scan(const value_type &first, const value_type &last, Fn f)
+    {
+        std::shared_lock<std::shared_mutex> repartition_lock(_repartition_mutex);
+        const _layout *layout = _current.load();
+
+        for (size_t i = _shard_of(layout, first), end = _shard_of(layout, last); i <= end && i < _shard_count; ++i)
+        {
+            std::shared_lock<std::shared_mutex> lock(_shards[i].mutex);
+            rb_tree<Ty> &tree = _shards[i].tree;
+            for (auto it = tree.lower_bound(first); it != tree.end() && *it < last; ++it)
+                f(*it);
+        }
+    }
+
+    // 按升序对所有元素调用 f，约定同 scan
+    template <typename Fn>
+    void for_each(Fn f)
+    {
+        std::shared_lock<std::shared_mutex> repartition_lock(_repartition_mutex);
+        for (size_t i = 0; i < _shard_count; ++i)
+        {
+            std::shared_lock<std::shared_mutex> lock(_shards[i].mutex);
+            for (const value_type &e : _shards[i].tree)
+                f(e);
+        }
+    }
+
+    // 立即按当前元素重新划分
+    void repartition()
+    {
+        std::unique_lock<std::shared_mutex> lock(_repartition_mutex);
+        _repartition();
+    }
+
+private:
+    std::unique_ptr<_shard[]> _shards;
+    size_t _shard_count;
+
+    std::atomic<_layout *> _current;       // 当前的划分
+    std::shared_mutex _repartition_mutex; // 重新划分时独占，扫描时共享，写者不使用
+    _epoch_domain _epoch;
+}; // class sharded_rb_tree<>
+
+} // namespace ds
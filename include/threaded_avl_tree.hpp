@@ -0,0 +1,563 @@
+﻿// threaded_avl_tree.hpp : 线索 AVL 树
+//
+
+#pragma once
+
+#include <cassert>
+#include <iterator>
+
+#include "_avl_balance.hpp"
+
+namespace ds
+{
+
+template <typename Ty>
+class threaded_avl_tree;
+
+// 迭代器
+// 只沿线索或孩子链接移动，不经由父节点回溯
+template <typename Ty>
+class _threaded_avl_tree_const_iterator
+{
+    friend class threaded_avl_tree<Ty>;
+
+public:
+    using iterator_category = std::bidirectional_iterator_tag;
+
+    using value_type = Ty;
+    using difference_type = ptrdiff_t;
+    using pointer = const value_type *;
+    using reference = const value_type &;
+
+private:
+    using _node = typename threaded_avl_tree<Ty>::_node;
+
+    _threaded_avl_tree_const_iterator(_node *node, bool is_end = false) : _ptr(node), _is_end(is_end) {}
+
+public:
+    // 解引用
+    [[nodiscard]] reference operator*() const
+    {
+        assert(!_is_end);
+        return _ptr->data;
+    }
+    [[nodiscard]] pointer operator->() const
+    {
+        assert(!_is_end);
+        return &_ptr->data;
+    }
+
+    // 自增
+    _threaded_avl_tree_const_iterator &operator++()
+    {
+        assert(!_is_end && _ptr);
+
+        _node *next = _ptr->next();
+        if (next)
+            _ptr = next;
+        else
+            _is_end = true; // 尾后
+
+        return *this;
+    }
+    _threaded_avl_tree_const_iterator operator++(int)
+    {
+        auto tmp = *this;
+        ++*this;
+        return tmp;
+    }
+
+    // 自减
+    _threaded_avl_tree_const_iterator &operator--()
+    {
+        if (_is_end)
+        {
+            assert(_ptr);
+            _is_end = false;
+            return *this;
+        }
+
+        _ptr = _ptr->prev();
+        assert(_ptr);
+        return *this;
+    }
+    _threaded_avl_tree_const_iterator operator--(int)
+    {
+        auto tmp = *this;
+        --*this;
+        return tmp;
+    }
+
+    friend bool operator==(const _threaded_avl_tree_const_iterator &left, const _threaded_avl_tree_const_iterator &right)
+    {
+        return left._ptr == right._ptr && left._is_end == right._is_end;
+    }
+    friend bool operator!=(const _threaded_avl_tree_const_iterator &left, const _threaded_avl_tree_const_iterator &right)
+    {
+        return !(left == right);
+    }
+
+private:
+    _node *_ptr;
+    bool _is_end = false;
+}; // class _threaded_avl_tree_const_iterator<>
+
+// 线索 AVL 树
+// 空的孩子链接指向中序前驱或后继，并以标记位区分。
+// 迭代器沿线索一步到达没有右子树的节点的后继，否则只需沿右子树的左链下降，
+// 完整遍历中每条链接至多经过两次，不必再沿父节点回溯到祖先
+template <typename Ty>
+class threaded_avl_tree
+{
+    friend class _threaded_avl_tree_const_iterator<Ty>;
+
+public:
+    using value_type = Ty;
+
+    using size_type = size_t;
+    using difference_type = ptrdiff_t;
+
+    using pointer = value_type *;
+    using reference = value_type &;
+    using const_pointer = const value_type *;
+    using const_reference = const value_type &;
+
+    using iterator = _threaded_avl_tree_const_iterator<Ty>;
+    using const_iterator = iterator;
+
+private:
+    // 标记位
+    enum : unsigned char
+    {
+        _left_thread = 1, // left 为指向前驱的线索
+        _right_thread = 2 // right 为指向后继的线索
+    };
+
+    // 二叉树节点
+    struct _node
+    {
+        value_type data;
+        signed char bf{};     // 平衡因子
+        unsigned char tags{}; // 线索标记
+
+        _node *parent = nullptr; // 父节点
+        _node *left = nullptr;   // 左子树或前驱
+        _node *right = nullptr;  // 右子树或后继
+
+        _node *left_child() const noexcept
+        {
+            return (tags & _left_thread) ? nullptr : left;
+        }
+        _node *right_child() const noexcept
+        {
+            return (tags & _right_thread) ? nullptr : right;
+        }
+
+        // 中序后继
+        _node *next() const noexcept
+        {
+            if (tags & _right_thread)
+                return right;
+
+            _node *p = right;
+            while (!(p->tags & _left_thread))
+                p = p->left;
+            return p;
+        }
+        // 中序前驱
+        _node *prev() const noexcept
+        {
+            if (tags & _left_thread)
+                return left;
+
+            _node *p = left;
+            while (!(p->tags & _right_thread))
+                p = p->right;
+            return p;
+        }
+
+        void set_left_thread(_node *pred) noexcept
+        {
+            left = pred;
+            tags |= _left_thread;
+        }
+        void set_right_thread(_node *succ) noexcept
+        {
+            right = succ;
+            tags |= _right_thread;
+        }
+        void set_left_child(_node *child) noexcept
+        {
+            left = child;
+            tags &= ~_left_thread;
+        }
+        void set_right_child(_node *child) noexcept
+        {
+            right = child;
+            tags &= ~_right_thread;
+        }
+    };
+
+public: // 构造函数
+    threaded_avl_tree()
+    {
+    }
+
+    template <typename InputIt>
+    threaded_avl_tree(InputIt first, InputIt last)
+    {
+        for (; first != last; ++first)
+            operator[](*first);
+    }
+
+    threaded_avl_tree(const threaded_avl_tree &) = delete;
+    threaded_avl_tree(threaded_avl_tree &&) = delete;
+    threaded_avl_tree &operator=(const threaded_avl_tree &) = delete;
+    threaded_avl_tree &operator=(threaded_avl_tree &&) = delete;
+
+    // 沿线索顺序释放，无需递归
+    ~threaded_avl_tree()
+    {
+        for (_node *p = _leftmost; p;)
+        {
+            _node *next = p->next();
+            delete p;
+            p = next;
+        }
+    }
+
+private:
+    // 将 parent 指向 node 的孩子链接改为 child
+    void _replace_child(_node *parent, _node *node, _node *child) noexcept
+    {
+        if (!parent)
+            _root = child;
+        else if (parent->left_child() == node)
+            parent->left = child;
+        else
+            parent->right = child;
+    }
+
+    static bool _is_left_child(const _node *node) noexcept
+    {
+        return node->parent && node->parent->left_child() == node;
+    }
+
+    // 左旋
+    void _left_rotate(_node *node)
+    {
+        /*
+           |            |
+           A <-         B
+          / \          / \
+         1   B  -->   A   3
+            / \      / \
+           2   3    1   2
+        */
+        _node *p = node->parent, *r = node->right_child();
+        assert(r);
+        _replace_child(p, node, r);
+        r->parent = p;
+
+        // B 没有左子树时，其前驱线索指向 A，旋转后 A 的后继即为 B
+        if (_node *rl = r->left_child())
+        {
+            node->set_right_child(rl);
+            rl->parent = node;
+        }
+        else
+            node->set_right_thread(r);
+
+        r->set_left_child(node);
+        node->parent = r;
+    }
+    // 右旋
+    void _right_rotate(_node *node)
+    {
+        /*
+             |           |
+             A <-        B
+            / \         / \
+           B   3  -->  1   A
+          / \             / \
+         1   2           2   3
+        */
+        _node *p = node->parent, *l = node->left_child();
+        assert(l);
+        _replace_child(p, node, l);
+        l->parent = p;
+
+        if (_node *lr = l->right_child())
+        {
+            node->set_left_child(lr);
+            lr->parent = node;
+        }
+        else
+            node->set_left_thread(l);
+
+        l->set_right_child(node);
+        node->parent = l;
+    }
+
+    // 平衡修正的适配器，见 _avl_balance.hpp
+    // 孩子一律经 left_child/right_child 读取，线索不会被当作孩子
+    struct _balance_ops
+    {
+        using handle = _node *;
+
+        threaded_avl_tree *tree;
+
+        static bool is_null(const _node *node) noexcept
+        {
+            return !node;
+        }
+        static _node *parent(const _node *node) noexcept
+        {
+            return node->parent;
+        }
+        static _node *left(const _node *node) noexcept
+        {
+            return node->left_child();
+        }
+        static _node *right(const _node *node) noexcept
+        {
+            return node->right_child();
+        }
+        static int bf(const _node *node) noexcept
+        {
+            return node->bf;
+        }
+        static void set_bf(_node *node, int bf) noexcept
+        {
+            node->bf = static_cast<signed char>(bf);
+        }
+        void left_rotate(_node *node) const
+        {
+            tree->_left_rotate(node);
+        }
+        void right_rotate(_node *node) const
+        {
+            tree->_right_rotate(node);
+        }
+    };
+
+    // 插入后修正
+    void _insert_fix_up(_node *node)
+    {
+        _avl_insert_fix_up(_balance_ops{this}, node);
+    }
+
+    // 删除后修正，is_left_child 表示 parent 的哪一侧高度降低
+    void _erase_fix_up(bool is_left_child, _node *parent)
+    {
+        _avl_erase_fix_up(_balance_ops{this}, is_left_child, parent);
+    }
+
+    // 从树中摘除节点并修正线索，不释放内存
+    void _unlink_node(_node *node)
+    {
+        _node *pred = node->prev(), *succ = node->next();
+        if (node == _leftmost)
+            _leftmost = succ;
+        if (node == _rightmost)
+            _rightmost = pred;
+
+        _node *left = node->left_child(), *right = node->right_child();
+        _node *parent;     // 高度降低的子树的父节点
+        bool is_left_side; // 高度降低的是哪一侧
+
+        if (left && right)
+        {
+            // 以后继 succ 代替 node，succ 没有左子树
+            // node 的前驱 pred 的后继线索改为指向 succ
+            pred->set_right_thread(succ);
+
+            _node *succ_right = succ->right_child();
+            if (succ->parent == node)
+            {
+                parent = succ;
+                is_left_side = false;
+            }
+            else
+            {
+                parent = succ->parent;
+                is_left_side = true;
+
+                // succ 的原位置由其右子树接替，没有右子树时留下指向 succ 的前驱线索
+                if (succ_right)
+                {
+                    parent->set_left_child(succ_right);
+                    succ_right->parent = parent;
+                }
+                else
+                    parent->set_left_thread(succ);
+
+                succ->set_right_child(right);
+                right->parent = succ;
+            }
+
+            _replace_child(node->parent, node, succ);
+            succ->parent = node->parent;
+            succ->set_left_child(left);
+            left->parent = succ;
+            succ->bf = node->bf;
+        }
+        else
+        {
+            parent = node->parent;
+            is_left_side = _is_left_child(node);
+
+            if (_node *child = left ? left : right)
+            {
+                // 子树中指向 node 的线索改为指向 node 的前驱或后继
+                if (left)
+                    pred->set_right_thread(succ);
+                else
+                    succ->set_left_thread(pred);
+
+                _replace_child(parent, node, child);
+                child->parent = parent;
+            }
+            else if (!parent)
+                _root = nullptr;
+            else if (is_left_side)
+                parent->set_left_thread(pred);
+            else
+                parent->set_right_thread(succ);
+        }
+
+        --_size;
+        if (parent)
+            _erase_fix_up(is_left_side, parent);
+    }
+
+    _node *_find_node(const value_type &val) const
+    {
+        _node *p = _root;
+        while (p)
+        {
+            if (p->data < val)
+                p = p->right_child();
+            else if (val < p->data)
+                p = p->left_child();
+            else
+                break;
+        }
+        return p;
+    }
+
+public:
+    // 插入元素
+    value_type &operator[](const value_type &e)
+    {
+        if (!_root)
+        {
+            // 树为空，两侧线索均为空
+            _root = _leftmost = _rightmost = new _node{e, 0, _left_thread | _right_thread};
+            ++_size;
+            return _root->data;
+        }
+
+        _node *p = _root;
+        while (true)
+        {
+            if (p->data < e)
+            {
+                if (_node *r = p->right_child())
+                {
+                    p = r;
+                    continue;
+                }
+
+                // 新节点继承 p 的后继线索，前驱为 p
+                _node *node = new _node{e, 0, _left_thread | _right_thread, p, p, p->right};
+                p->set_right_child(node);
+                if (p == _rightmost)
+                    _rightmost = node;
+
+                ++_size;
+                _insert_fix_up(node);
+                return node->data;
+            }
+            else if (e < p->data)
+            {
+                if (_node *l = p->left_child())
+                {
+                    p = l;
+                    continue;
+                }
+
+                _node *node = new _node{e, 0, _left_thread | _right_thread, p, p->left, p};
+                p->set_left_child(node);
+                if (p == _leftmost)
+                    _leftmost = node;
+
+                ++_size;
+                _insert_fix_up(node);
+                return node->data;
+            }
+            else
+                return p->data;
+        }
+    }
+
+    // 查找元素
+    [[nodiscard]] const_iterator search(const value_type &val) const
+    {
+        _node *p = _find_node(val);
+        return p ? const_iterator{p} : end();
+    }
+
+    // 删除元素
+    bool erase(const value_type &val)
+    {
+        _node *p = _find_node(val);
+        if (!p)
+            return false;
+
+        _unlink_node(p);
+        delete p;
+        return true;
+    }
+
+    // 删除迭代器指向的元素，返回其后继
+    const_iterator erase(const_iterator it)
+    {
+        assert(!it._is_end);
+
+        _node *p = it._ptr;
+        _node *next = p->next();
+        _unlink_node(p);
+        delete p;
+        return next ? const_iterator{next} : end();
+    }
+
+    [[nodiscard]] size_type size() const noexcept
+    {
+        return _size;
+    }
+
+    [[nodiscard]] bool empty() const noexcept
+    {
+        return _size == 0;
+    }
+
+    // 迭代器
+    [[nodiscard]] iterator begin() const
+    {
+        return _leftmost ? iterator{_leftmost} : end();
+    }
+
+    [[nodiscard]] iterator end() const
+    {
+        return {_rightmost, true};
+    }
+
+private:
+    _node *_root = nullptr;      // 根节点
+    _node *_leftmost = nullptr;  // 最小节点
+    _node *_rightmost = nullptr; // 最大节点
+    size_type _size = 0;         // 元素数量
+};                               // class threaded_avl_tree<>
+
+} // namespace ds
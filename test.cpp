@@ -1,26 +1,60 @@
 ﻿#include <iostream>
 #include <array>
 #include <algorithm>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "include/avl_tree.hpp"
+#include "include/avl_map.hpp"
+#include "include/interval_tree.hpp"
+#include "include/persistent_avl_tree.hpp"
+#include "include/compact_avl_tree.hpp"
+#include "include/threaded_avl_tree.hpp"
+#include "include/buffered_avl_tree.hpp"
 #include "include/seq_list.hpp"
 #include "include/stack.hpp"
 #include "include/b_tree.hpp"
 #include "include/rb_tree.hpp"
+#include "include/counted_rb_tree.hpp"
+#include "include/intrusive_rb_tree.hpp"
+#include "include/concurrent_rb_tree.hpp"
+#include "include/sharded_rb_tree.hpp"
 
 void test_seq_list();
 void test_stack();
 void test_avl_tree();
+void test_avl_map();
+void test_interval_tree();
+void test_persistent_avl_tree();
+void test_compact_avl_tree();
+void test_threaded_avl_tree();
+void test_buffered_avl_tree();
 void test_b_tree();
 void test_rb_tree();
+void test_counted_rb_tree();
+void test_intrusive_rb_tree();
+void test_concurrent_rb_tree();
+void test_sharded_rb_tree();
 
 int main()
 {
     test_seq_list();
     test_stack();
     test_avl_tree();
+    test_avl_map();
+    test_interval_tree();
+    test_persistent_avl_tree();
+    test_compact_avl_tree();
+    test_threaded_avl_tree();
+    test_buffered_avl_tree();
     test_b_tree();
     test_rb_tree();
+    test_counted_rb_tree();
+    test_intrusive_rb_tree();
+    test_concurrent_rb_tree();
+    test_sharded_rb_tree();
 
     return 0;
 }
@@ -65,7 +99,218 @@ void test_avl_tree()
     tree.erase(3);
 
     auto it = tree.search(3);
-    std::cout << (it == tree.end()) << "\n预期输出：1\n\n";
+    std::cout << (it == tree.end()) << "\n预期输出：1\n";
+
+    auto hint = tree.insert(tree.end(), 5);
+    tree.insert(hint, 4);
+
+    for (int i : tree.range(1, 5))
+    {
+        std::cout << i << " ";
+    }
+    std::cout << *tree.lower_bound(2) << "\n预期输出：1 2 4 2\n";
+
+    // 批量查找
+    std::array<int, 3> keys({4, 3, 0});
+    std::vector<ds::avl_tree<int>::const_iterator> found;
+    tree.search_many(keys.begin(), keys.end(), std::back_inserter(found));
+    for (auto i : found)
+    {
+        std::cout << (i == tree.end() ? -1 : *i) << " ";
+    }
+    std::cout << "\n预期输出：4 -1 0\n";
+
+    // 二进制快照
+    std::stringstream stream;
+    tree.save(stream);
+    std::string bytes = stream.str();
+    ds::avl_tree<int> loaded(stream), mapped(bytes.data(), bytes.size());
+
+    bytes[bytes.size() / 2] ^= 1;
+    bool rejected = false;
+    try
+    {
+        ds::avl_tree<int> corrupted(bytes.data(), bytes.size());
+    }
+    catch (const std::runtime_error &)
+    {
+        rejected = true;
+    }
+
+    for (int i : loaded)
+    {
+        std::cout << i << " ";
+    }
+    std::cout << mapped.size() << rejected << "\n预期输出：0 1 2 4 5 51\n\n";
+}
+
+void test_avl_map()
+{
+    std::cout << "-------- avl_map --------" << std::endl;
+
+    ds::avl_map<int, std::string> map{{2, "b"}, {1, "a"}};
+    map.try_emplace(1, "x");
+    map.insert_or_assign(2, "c");
+    map[3] = "d";
+
+    for (auto &[key, value] : map)
+    {
+        std::cout << key << value << " ";
+    }
+    std::cout << (map.find(4) == map.end()) << "\n预期输出：1a 2c 3d 1\n\n";
+}
+
+void test_interval_tree()
+{
+    std::cout << "-------- interval_tree --------" << std::endl;
+
+    ds::interval_tree<int> tree;
+    tree.insert(1, 3);
+    tree.insert(2, 8);
+    tree.insert(5, 6);
+    tree.insert(9, 10);
+    tree.erase({5, 6});
+
+    tree.query(4, 9, [](const ds::interval<int> &i) {
+        std::cout << i.low << "-" << i.high << " ";
+    });
+    // stab 按槽位的顺序报告，不按左端点排序
+    tree.stab(3, [](const ds::interval<int> &i) {
+        std::cout << i.low << "-" << i.high << " ";
+    });
+
+    std::cout << "\n预期输出：2-8 9-10 2-8 1-3\n\n";
+}
+
+void test_persistent_avl_tree()
+{
+    std::cout << "-------- persistent_avl_tree --------" << std::endl;
+
+    std::array<int, 4> arr({3, 1, 2, 1});
+    ds::persistent_avl_tree<int> tree(arr.begin(), arr.end());
+
+    auto snapshot = tree.get_snapshot();
+    tree.erase(2);
+    tree.insert(4);
+
+    for (int i : snapshot)
+    {
+        std::cout << i << " ";
+    }
+    std::cout << tree.contains(2) << tree.size() << "\n预期输出：1 2 3 03\n";
+
+    // 复制元素时抛出异常，本次修改被撤销，树保持原状
+    static int copies_left = -1; // 为 0 时复制抛出异常，为负数时不限制
+    struct fragile
+    {
+        int value;
+
+        fragile(int v) : value(v) {}
+        fragile(const fragile &other) : value(other.value)
+        {
+            if (copies_left == 0)
+                throw std::runtime_error("复制失败");
+            if (copies_left > 0)
+                --copies_left;
+        }
+
+        bool operator<(const fragile &other) const
+        {
+            return value < other.value;
+        }
+    };
+
+    ds::persistent_avl_tree<fragile> fragile_tree;
+    for (int i = 0; i < 20; ++i)
+        fragile_tree.insert(i);
+
+    int failures = 0;
+    for (int limit : {0, 2, 4})
+    {
+        copies_left = limit;
+        try
+        {
+            fragile_tree.erase(limit == 0 ? 100 : 7);
+            fragile_tree.insert(100);
+        }
+        catch (const std::runtime_error &)
+        {
+            ++failures;
+        }
+    }
+    copies_left = -1;
+    fragile_tree.insert(20);
+    fragile_tree.erase(3);
+
+    std::cout << failures << fragile_tree.contains(7) << fragile_tree.contains(100) << fragile_tree.size();
+    std::cout << "\n预期输出：30019\n\n";
+}
+
+void test_compact_avl_tree()
+{
+    std::cout << "-------- compact_avl_tree --------" << std::endl;
+
+    std::array<int, 5> arr({1, 3, 2, 1, 0});
+    ds::compact_avl_tree<int> tree(arr.begin(), arr.end());
+
+    tree.erase(3);
+    tree[4];
+
+    for (int i : tree)
+    {
+        std::cout << i << " ";
+    }
+    std::cout << "\n预期输出：0 1 2 4\n\n";
+}
+
+void test_threaded_avl_tree()
+{
+    std::cout << "-------- threaded_avl_tree --------" << std::endl;
+
+    std::array<int, 5> arr({1, 3, 2, 1, 0});
+    ds::threaded_avl_tree<int> tree(arr.begin(), arr.end());
+
+    tree.erase(1);
+
+    // 倒序输出
+    for (auto it = tree.end(); it != tree.begin();)
+    {
+        std::cout << *--it << " ";
+    }
+    std::cout << "\n预期输出：3 2 0\n\n";
+}
+
+void test_buffered_avl_tree()
+{
+    std::cout << "-------- buffered_avl_tree --------" << std::endl;
+
+    ds::buffered_avl_tree<int> tree(4);
+    for (int i : {5, 1, 4, 1, 3, 2})
+    {
+        tree.insert(i);
+    }
+    tree.erase(3);
+
+    std::cout << tree.pending() << tree.contains(2) << " ";
+    for (int i : tree)
+    {
+        std::cout << i << " ";
+    }
+    std::cout << "\n预期输出：11 1 2 4 5\n";
+
+    // 缓冲区相对于树较小时一次并入而不逐个插入，与树中重复的元素被丢弃
+    // size 不并入缓冲区，也不计入与树中重复的缓冲元素
+    ds::buffered_avl_tree<int> large(8);
+    for (int i = 0; i < 100; ++i)
+    {
+        large.insert(i * 2);
+    }
+    large.insert(7);
+    large.insert(8);
+    large.insert(9);
+
+    std::cout << large.size() << " " << large.pending() << " " << large.contains(7) << large.contains(8) << large.contains(11);
+    std::cout << "\n预期输出：102 7 110\n\n";
 }
 
 void test_b_tree()
@@ -97,4 +342,301 @@ void test_rb_tree()
         std::cout << i << " ";
     }
     std::cout << "\n预期输出：0 1 1 2 3\n";
+
+    // 有序批量插入
+    std::array<int, 4> batch({-1, 2, 4, 5});
+    tree.insert_sorted(batch.begin(), batch.end());
+
+    for (int i : tree)
+    {
+        std::cout << i << " ";
+    }
+    std::cout << "\n预期输出：-1 0 1 1 2 2 3 4 5\n";
+
+    // 节点在树之间移动，不重新分配
+    ds::rb_tree<int> other;
+    other.emplace(7);
+    other.insert(tree.extract(tree.find(2)));
+    tree.merge(other);
+
+    for (int i : tree)
+    {
+        std::cout << i << " ";
+    }
+    std::cout << std::distance(other.begin(), other.end()) << "\n预期输出：-1 0 1 1 2 2 3 4 5 7 0\n";
+
+    // 删除不移动其他元素
+    const int *next = &*std::next(tree.find(3));
+    tree.erase(tree.find(3));
+    std::cout << (next == &*tree.find(4)) << "\n预期输出：1\n";
+
+    // 顺序统计，需要节点维护子树大小
+    ds::rb_tree<int, true> ranked(tree.begin(), tree.end());
+    std::cout << ranked.size() << " " << ranked.rank(2) << " " << *ranked.select(8) << " " << ranked.index_of(ranked.find(4));
+    ranked.erase(ranked.select(1), ranked.select(3));
+    ranked.pop_min();
+    std::cout << " " << *ranked.select(1) << " " << ranked.distance(ranked.find(4), ranked.end());
+    std::cout << "\n预期输出：9 4 7 6 2 3\n";
+
+    // 最值
+    int min = tree.pop_min(), max = tree.pop_max();
+    std::cout << min << " " << max << " " << tree.min() << " " << tree.max() << "\n预期输出：-1 7 0 5\n";
+
+    // 冻结为只读索引
+    auto index = tree.freeze();
+    for (int i : index)
+    {
+        std::cout << i << " ";
+    }
+    std::cout << *index.lower_bound(3) << index.contains(3) << "\n预期输出：0 1 1 2 2 4 5 40\n";
+
+    // 紧凑化
+    bool compacted = tree.compact();
+    for (int i : tree)
+    {
+        std::cout << i << " ";
+    }
+    std::cout << compacted << "\n预期输出：0 1 1 2 2 4 5 1\n";
+
+    // 内存块中的节点同样原样取出，元素不被复制
+    const int *four = &*tree.find(4);
+    auto handle = tree.extract(tree.find(4));
+    std::cout << (&handle.value() == four);
+    tree.insert(std::move(handle));
+    std::cout << (&*tree.find(4) == four) << "\n预期输出：11\n";
+
+    // 批量查找
+    std::array<int, 3> keys({5, 3, 1});
+    std::vector<ds::rb_tree<int>::const_iterator> found;
+    tree.find_many(keys.begin(), keys.end(), std::back_inserter(found));
+    for (auto i : found)
+    {
+        std::cout << (i == tree.end() ? -1 : *i) << " ";
+    }
+    std::cout << "\n预期输出：5 -1 1\n";
+
+    // 批量删除
+    tree.erase(std::next(tree.begin()), std::next(tree.begin(), 3));
+    size_t erased = tree.erase_if([](int i) { return i % 2 == 0; });
+
+    for (int i : tree)
+    {
+        std::cout << i << " ";
+    }
+    std::cout << erased << "\n预期输出：5 4\n";
+
+    // 多线程批量建立
+    std::array<int, 6> unsorted({5, 3, 9, 1, 3, 7});
+    ds::rb_tree bulk(unsorted.begin(), unsorted.end(), 4);
+    for (int i : bulk)
+    {
+        std::cout << i << " ";
+    }
+    std::cout << "\n预期输出：1 3 3 5 7 9\n";
+
+    // 二进制快照
+    std::stringstream stream;
+    bulk.save(stream);
+    ds::rb_tree<int> loaded(stream);
+    for (int i : loaded)
+    {
+        std::cout << i << " ";
+    }
+    std::cout << "\n预期输出：1 3 3 5 7 9\n";
+
+    // 每个线程独立修改自己的树
+    std::vector<int> sizes(4);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([t, &sizes]() {
+            std::array<int, 1> seed({t});
+            ds::rb_tree<int> local(seed.begin(), seed.end());
+            for (int i = 0; i < 2000; ++i)
+                local.insert((i * 7919 + t) % 1000);
+            for (int i = 0; i < 1000; i += 2)
+                local.erase(local.find(i));
+            sizes[t] = static_cast<int>(std::distance(local.begin(), local.end()));
+        });
+    }
+    for (std::thread &th : threads)
+        th.join();
+
+    for (int n : sizes)
+    {
+        std::cout << n << " ";
+    }
+    std::cout << "\n预期输出：1501 1501 1501 1501\n\n";
+}
+
+void test_counted_rb_tree()
+{
+    std::cout << "-------- counted_rb_tree --------" << std::endl;
+
+    std::array<int, 6> arr({2, 1, 2, 3, 2, 1});
+    ds::counted_rb_tree<int> tree(arr.begin(), arr.end());
+
+    tree.insert(3, 2);
+    tree.erase(tree.find(2));
+    tree.erase(1);
+
+    for (int i : tree)
+    {
+        std::cout << i << " ";
+    }
+    std::cout << tree.count(2) << tree.count(3) << tree.distinct() << "\n预期输出：2 2 3 3 3 232\n\n";
+}
+
+void test_intrusive_rb_tree()
+{
+    std::cout << "-------- intrusive_rb_tree --------" << std::endl;
+
+    struct connection : ds::rb_tree_hook<>
+    {
+        int id;
+
+        bool operator<(const connection &other) const
+        {
+            return id < other.id;
+        }
+    };
+
+    // 元素由调用方管理，树只串起挂钩
+    std::array<connection, 4> pool;
+    for (int i = 0; i < 4; ++i)
+        pool[i].id = (i * 3) % 4;
+
+    ds::intrusive_rb_tree<connection> tree(pool.begin(), pool.end());
+    tree.erase(pool[1]);
+
+    for (const connection &c : tree)
+    {
+        std::cout << c.id << " ";
+    }
+    std::cout << (&*tree.find(pool[2]) == &pool[2]) << "\n预期输出：0 1 2 1\n";
+
+    // 副本不带原元素的链接，可以放入另一棵树；只读的树给出只读迭代器
+    connection copy = pool[2];
+    ds::intrusive_rb_tree<connection> single;
+    single.insert(copy);
+    const auto &view = tree;
+    std::cout << single.size() << tree.size() << (view.iterator_to(pool[0]) == view.begin()) << (single.begin()->id);
+    std::cout << "\n预期输出：1312\n\n";
+}
+
+void test_concurrent_rb_tree()
+{
+    std::cout << "-------- concurrent_rb_tree --------" << std::endl;
+
+    std::array<int, 4> arr({3, 1, 2, 1});
+    ds::concurrent_rb_tree<int> tree(arr.begin(), arr.end());
+
+    // 读者与写者并发，读者总能看到未被修改的元素
+    std::thread writer([&tree]() {
+        for (int i = 4; i < 1000; ++i)
+            tree.insert(i);
+        for (int i = 4; i < 1000; i += 2)
+            tree.erase(i);
+    });
+    bool ok = true;
+    for (int i = 0; i < 1000; ++i)
+        ok = ok && tree.contains(1) && tree.contains(2) && tree.contains(3);
+    writer.join();
+
+    auto snapshot = tree.get_snapshot();
+    tree.erase(2);
+
+    for (auto it = snapshot.begin(); *it < 6; ++it)
+    {
+        std::cout << *it << " ";
+    }
+    std::cout << ok << tree.contains(2) << tree.size() << "\n预期输出：1 2 3 5 10500\n";
+
+    // 长期持有的读者只登记一次纪元，每次查找都看到最新发布的版本
+    auto reader = tree.get_reader();
+    bool before = reader.contains(2000);
+    tree.insert(2000);
+    reader.refresh();
+    std::cout << before << reader.contains(2000) << " " << *reader.lower_bound(1000) << " " << reader.size();
+    std::cout << "\n预期输出：01 2000 501\n";
+
+    // 复制元素时抛出异常，本次修改被撤销，树保持原状
+    static int copies_left = -1; // 为 0 时复制抛出异常，为负数时不限制
+    struct fragile
+    {
+        int value;
+
+        fragile(int v) : value(v) {}
+        fragile(const fragile &other) : value(other.value)
+        {
+            if (copies_left == 0)
+                throw std::runtime_error("复制失败");
+            if (copies_left > 0)
+                --copies_left;
+        }
+        fragile &operator=(const fragile &) = default;
+
+        bool operator<(const fragile &other) const
+        {
+            return value < other.value;
+        }
+    };
+
+    ds::concurrent_rb_tree<fragile> fragile_tree;
+    for (int i = 0; i < 20; ++i)
+        fragile_tree.insert(i);
+
+    int failures = 0;
+    for (int limit : {0, 2, 4})
+    {
+        copies_left = limit;
+        try
+        {
+            fragile_tree.erase(limit == 0 ? 100 : 7);
+            fragile_tree.insert(100);
+        }
+        catch (const std::runtime_error &)
+        {
+            ++failures;
+        }
+    }
+    copies_left = -1;
+    fragile_tree.insert(20);
+    fragile_tree.erase(3);
+
+    std::cout << failures << fragile_tree.contains(7) << fragile_tree.contains(100) << fragile_tree.size();
+    std::cout << "\n预期输出：31020\n\n";
+}
+
+void test_sharded_rb_tree()
+{
+    std::cout << "-------- sharded_rb_tree --------" << std::endl;
+
+    ds::sharded_rb_tree<int> tree(4);
+
+    // 多个写者并发插入，分片随数据增长自动重新划分
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t)
+    {
+        writers.emplace_back([t, &tree]() {
+            for (int i = t; i < 8000; i += 4)
+                tree.insert(i);
+            for (int i = t; i < 8000; i += 8)
+                tree.erase(i);
+        });
+    }
+    for (std::thread &th : writers)
+        th.join();
+
+    // 跨分片的有序遍历与范围扫描
+    int prev = -1;
+    bool sorted = true;
+    tree.for_each([&](int i) {
+        sorted = sorted && prev < i;
+        prev = i;
+    });
+
+    tree.scan(1000, 1010, [](int i) { std::cout << i << " "; });
+    std::cout << tree.size() << " " << sorted << tree.contains(5) << tree.contains(8);
+    std::cout << "\n预期输出：1004 1005 1006 1007 4000 110\n";
 }